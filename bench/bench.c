@@ -0,0 +1,502 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The code we want to measure.
+#include "allocator.h"
+
+// Used for printf.
+#include <stdio.h>
+
+// Used for the buffers and qsort.
+#include <stdlib.h>
+
+// Used to move the slots of a trace along with a compaction.
+#include <string.h>
+
+// Used to time the operations.
+#include <time.h>
+
+// Used for the latencies.
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of operations of each synthetic workload.
+#define WORKLOAD_OPS 400000
+
+// The number of live allocations the synthetic workloads hover around.
+#define TARGET_LIVE 4096
+
+// The number of allocations a trace may keep alive at once.
+#define MAX_SLOTS 65536
+
+// The number of blocks of the memory the workloads run against.
+#define MEMORY_LENGTH (1u << 26)
+
+/********************************** STRUCTS ***********************************/
+
+// The kinds of operations of a trace.
+enum OpKind {
+    OP_MALLOC, // Allocates size blocks into a slot.
+    OP_FREE,   // Frees the allocation of a slot.
+};
+
+// A single operation of a trace. Allocations are named by a slot rather than
+// by their address, so that a trace can be replayed with any policy.
+struct Op {
+    enum OpKind kind;  // What the operation does.
+    unsigned int slot; // The allocation the operation works on.
+    unsigned int size; // The number of blocks to allocate.
+};
+
+// A sequence of operations, always freeing everything it allocates.
+struct Trace {
+    const char *name;                   // The name of the workload.
+    struct Op *ops;                     // The operations.
+    unsigned int length;                // The number of operations.
+    unsigned int capacity;              // The number of operations that fit
+                                        // in ops.
+    unsigned int free_slots[MAX_SLOTS]; // The slots not in use, as a stack.
+    unsigned int free_count;            // The number of slots not in use.
+};
+
+// What a replay of a trace measured.
+struct Report {
+    double ops_per_second;      // The throughput of an untimed replay.
+    uint64_t *malloc_latencies; // The latency of each allocation.
+    unsigned int malloc_count;  // The number of allocations.
+    uint64_t *free_latencies;   // The latency of each free.
+    unsigned int free_count;    // The number of frees.
+    unsigned int peak_segments; // The highest number of free segments.
+    double fragmentation;       // The mean part of the used memory which is
+                                // free.
+};
+
+/********************************* PROTOYPES **********************************/
+
+// Sets up an empty trace with room for the given number of operations.
+void trace_init(struct Trace *trace, const char *name, unsigned int capacity);
+
+// Releases the operations of a trace.
+void trace_destroy(struct Trace *trace);
+
+// Appends an allocation to a trace and returns its slot.
+unsigned int trace_malloc(struct Trace *trace, unsigned int size);
+
+// Appends a free to a trace.
+void trace_free(struct Trace *trace, unsigned int slot);
+
+// Sizes uniform in [1, 64], random lifetimes.
+void generate_uniform(struct Trace *trace);
+
+// Sizes following a power law, small sizes being the most frequent, random
+// lifetimes.
+void generate_power_law(struct Trace *trace);
+
+// Allocations freed in the order they were made, like buffers going through a
+// queue.
+void generate_producer_consumer(struct Trace *trace);
+
+// The memory is filled first, then each free is followed by an allocation of
+// another size.
+void generate_churn(struct Trace *trace);
+
+// Reads a binary trace recorded with allocator_record. The alignments are
+// dropped and each resize becomes a free followed by an allocation. Returns 0
+// if the file could not be mapped.
+int read_trace(struct Trace *trace, const char *path);
+
+// Frees all the slots still in use at the end of a trace.
+void free_remaining(struct Trace *trace, const unsigned int *slots,
+                    unsigned int count);
+
+// Replays a trace against a new Allocator with the given policy.
+struct Report replay(const struct Trace *trace, enum AllocationPolicy policy);
+
+// Prints a line of results.
+void print_report(const struct Trace *trace, enum AllocationPolicy policy,
+                  struct Report *report);
+
+// Releases the latencies of a report.
+void report_destroy(struct Report *report);
+
+// Returns the current time in nanoseconds.
+uint64_t now_ns(void);
+
+// Returns the next pseudo-random number of a xorshift generator.
+unsigned int next_random(void);
+
+// Compares two latencies for qsort.
+int compare_latencies(const void *a, const void *b);
+
+// Returns the latency at the given percentile, in tenths of a percent, of
+// sorted latencies.
+unsigned long long percentile(const uint64_t *latencies, unsigned int count,
+                              unsigned int permille);
+
+/*********************************** GLOBALS **********************************/
+
+// The state of the pseudo-random generator.
+static unsigned int random_state = 2021;
+
+// The names of the policies.
+static const char *policy_names[] = {"segregated", "first", "next", "best",
+                                     "worst"};
+
+/************************************ MAIN ************************************/
+
+int main(int argc, char **argv) {
+    // The synthetic workloads, followed by the recorded ones.
+    void (*generators[])(struct Trace *) = {
+        generate_uniform, generate_power_law, generate_producer_consumer,
+        generate_churn};
+    const char *names[] = {"uniform", "power-law", "producer-consumer",
+                           "churn"};
+    unsigned int synthetic_count = sizeof(generators) / sizeof(generators[0]);
+
+    printf("%-18s %-10s %9s %21s %21s %8s %6s\n", "workload", "policy",
+           "Mops/s", "malloc p50/p99/p99.9", "free p50/p99/p99.9",
+           "peak seg", "frag");
+    for (unsigned int i = 0; i < synthetic_count + argc - 1; i++) {
+        static struct Trace trace;
+        if (i < synthetic_count) {
+            trace_init(&trace, names[i], WORKLOAD_OPS + 2 * TARGET_LIVE);
+            generators[i](&trace);
+        } else if (!read_trace(&trace, argv[i - synthetic_count + 1])) {
+            fprintf(stderr, "Could not read %s\n",
+                    argv[i - synthetic_count + 1]);
+            continue;
+        }
+        for (enum AllocationPolicy policy = SEGREGATED_FIT; policy <= WORST_FIT;
+             policy++) {
+            struct Report report = replay(&trace, policy);
+            print_report(&trace, policy, &report);
+            report_destroy(&report);
+        }
+        trace_destroy(&trace);
+    }
+    return 0;
+}
+
+/********************************* FUNCTIONS **********************************/
+
+// Sets up an empty trace with room for the given number of operations.
+void trace_init(struct Trace *trace, const char *name, unsigned int capacity) {
+    trace->name = name;
+    trace->ops = malloc(capacity * sizeof(struct Op));
+    trace->length = 0;
+    trace->capacity = capacity;
+    // The lowest slots are handed out first.
+    for (unsigned int i = 0; i < MAX_SLOTS; i++) {
+        trace->free_slots[i] = MAX_SLOTS - 1 - i;
+    }
+    trace->free_count = MAX_SLOTS;
+}
+
+// Releases the operations of a trace.
+void trace_destroy(struct Trace *trace) { free(trace->ops); }
+
+// Appends an allocation to a trace and returns its slot.
+unsigned int trace_malloc(struct Trace *trace, unsigned int size) {
+    if (trace->length == trace->capacity) {
+        trace->capacity *= 2;
+        trace->ops = realloc(trace->ops, trace->capacity * sizeof(struct Op));
+    }
+    trace->free_count--;
+    unsigned int slot = trace->free_slots[trace->free_count];
+    trace->ops[trace->length++] =
+        (struct Op){.kind = OP_MALLOC, .slot = slot, .size = size};
+    return slot;
+}
+
+// Appends a free to a trace.
+void trace_free(struct Trace *trace, unsigned int slot) {
+    if (trace->length == trace->capacity) {
+        trace->capacity *= 2;
+        trace->ops = realloc(trace->ops, trace->capacity * sizeof(struct Op));
+    }
+    trace->free_slots[trace->free_count++] = slot;
+    trace->ops[trace->length++] =
+        (struct Op){.kind = OP_FREE, .slot = slot, .size = 0};
+}
+
+// Sizes uniform in [1, 64], random lifetimes.
+void generate_uniform(struct Trace *trace) {
+    static unsigned int live[2 * TARGET_LIVE];
+    unsigned int live_count = 0;
+    while (trace->length < WORKLOAD_OPS) {
+        // Allocations are more likely while the live count is below the
+        // target, and frees above it.
+        if (next_random() % (2 * TARGET_LIVE) >= live_count) {
+            live[live_count++] = trace_malloc(trace, 1 + next_random() % 64);
+        } else {
+            // A random allocation dies.
+            unsigned int victim = next_random() % live_count;
+            trace_free(trace, live[victim]);
+            live[victim] = live[--live_count];
+        }
+    }
+    free_remaining(trace, live, live_count);
+}
+
+// Sizes following a power law, small sizes being the most frequent, random
+// lifetimes.
+void generate_power_law(struct Trace *trace) {
+    static unsigned int live[2 * TARGET_LIVE];
+    unsigned int live_count = 0;
+    while (trace->length < WORKLOAD_OPS) {
+        if (next_random() % (2 * TARGET_LIVE) >= live_count) {
+            // Each power of two is half as likely as the previous one, up to
+            // 1024 blocks.
+            unsigned int order = __builtin_ctz(next_random() | (1u << 10));
+            unsigned int size =
+                (1u << order) + next_random() % (1u << order);
+            live[live_count++] = trace_malloc(trace, size);
+        } else {
+            unsigned int victim = next_random() % live_count;
+            trace_free(trace, live[victim]);
+            live[victim] = live[--live_count];
+        }
+    }
+    free_remaining(trace, live, live_count);
+}
+
+// Allocations freed in the order they were made, like buffers going through a
+// queue.
+void generate_producer_consumer(struct Trace *trace) {
+    static unsigned int queue[TARGET_LIVE];
+    unsigned int oldest = 0;
+    unsigned int live_count = 0;
+    while (trace->length < WORKLOAD_OPS) {
+        // The producer and the consumer take turns in bursts of random length.
+        unsigned int burst = 1 + next_random() % 64;
+        int produce = (live_count < TARGET_LIVE / 2) ||
+                      ((live_count + burst <= TARGET_LIVE) &&
+                       (next_random() % 2 == 0));
+        for (unsigned int i = 0; i < burst; i++) {
+            if (produce && (live_count < TARGET_LIVE)) {
+                queue[(oldest + live_count) % TARGET_LIVE] =
+                    trace_malloc(trace, 1 + next_random() % 64);
+                live_count++;
+            } else if (!produce && (live_count > 0)) {
+                trace_free(trace, queue[oldest]);
+                oldest = (oldest + 1) % TARGET_LIVE;
+                live_count--;
+            }
+        }
+    }
+    while (live_count > 0) {
+        trace_free(trace, queue[oldest]);
+        oldest = (oldest + 1) % TARGET_LIVE;
+        live_count--;
+    }
+}
+
+// The memory is filled first, then each free is followed by an allocation of
+// another size.
+void generate_churn(struct Trace *trace) {
+    static unsigned int live[TARGET_LIVE];
+    for (unsigned int i = 0; i < TARGET_LIVE; i++) {
+        live[i] = trace_malloc(trace, 1 + next_random() % 256);
+    }
+    while (trace->length < WORKLOAD_OPS) {
+        unsigned int victim = next_random() % TARGET_LIVE;
+        trace_free(trace, live[victim]);
+        live[victim] = trace_malloc(trace, 1 + next_random() % 256);
+    }
+    free_remaining(trace, live, TARGET_LIVE);
+}
+
+// Reads a binary trace recorded with allocator_record. The alignments are
+// dropped and each resize becomes a free followed by an allocation. Returns 0
+// if the file could not be mapped.
+int read_trace(struct Trace *trace, const char *path) {
+    struct MappedTrace mapped;
+    if (!map_trace(&mapped, path)) {
+        return 0;
+    }
+    trace_init(trace, path, mapped.length + 1);
+    // The recorded addresses are mapped to the slots of the trace, plus one so
+    // that 0 means no slot.
+    block_ptr memory_start = mapped.header->memory_start;
+    unsigned int memory_length = mapped.header->memory_length;
+    unsigned int *slots = calloc(memory_length, sizeof(unsigned int));
+    for (size_t i = 0; i < mapped.length; i++) {
+        const struct TraceRecord *record = &mapped.records[i];
+        unsigned int *slot = &slots[record->address - memory_start];
+        if (((record->op == TRACE_MALLOC) || (record->op == TRACE_REALLOC)) &&
+            (trace->free_count == 0)) {
+            // The trace keeps more allocations alive than the benchmark can.
+            break;
+        } else if (record->op == TRACE_MALLOC) {
+            *slot = trace_malloc(trace, record->size) + 1;
+        } else if ((record->op == TRACE_FREE) && (*slot != 0)) {
+            trace_free(trace, *slot - 1);
+            *slot = 0;
+        } else if ((record->op == TRACE_REALLOC) && (*slot != 0)) {
+            trace_free(trace, *slot - 1);
+            *slot = 0;
+            slots[record->argument - memory_start] =
+                trace_malloc(trace, record->size) + 1;
+        } else if (record->op == TRACE_COMPACT) {
+            // The slots of the run are now found under its new addresses.
+            memmove(&slots[record->argument - memory_start], slot,
+                    record->size * sizeof(unsigned int));
+            // The part of the former run the new one does not cover is empty.
+            block_ptr vacated = record->argument + record->size;
+            if (vacated < record->address) {
+                vacated = record->address;
+            }
+            for (block_ptr i = vacated; i < record->address + record->size;
+                 i++) {
+                slots[i - memory_start] = 0;
+            }
+        }
+    }
+    // A trace always frees everything it allocates.
+    for (unsigned int i = 0; i < memory_length; i++) {
+        if (slots[i] != 0) {
+            trace_free(trace, slots[i] - 1);
+        }
+    }
+    free(slots);
+    unmap_trace(&mapped);
+    return 1;
+}
+
+// Frees all the slots still in use at the end of a trace.
+void free_remaining(struct Trace *trace, const unsigned int *slots,
+                    unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        trace_free(trace, slots[i]);
+    }
+}
+
+// Replays a trace against a new Allocator with the given policy.
+struct Report replay(const struct Trace *trace, enum AllocationPolicy policy) {
+    static block_ptr addresses[MAX_SLOTS];
+    static unsigned int sizes[MAX_SLOTS];
+    struct Segment memory = {.start = 0, .length = MEMORY_LENGTH};
+    size_t metadata_size = allocator_metadata_size(2 * MAX_SLOTS);
+    void *metadata = malloc(metadata_size);
+    struct Report report = {0};
+
+    // A first replay measures the throughput without the cost of the timers.
+    struct Allocator allocator =
+        new_allocator_in(memory, policy, metadata, metadata_size);
+    uint64_t start = now_ns();
+    for (unsigned int i = 0; i < trace->length; i++) {
+        const struct Op *op = &trace->ops[i];
+        if (op->kind == OP_MALLOC) {
+            addresses[op->slot] = block_malloc(&allocator, op->size);
+        } else {
+            block_free(&allocator, addresses[op->slot]);
+        }
+    }
+    report.ops_per_second = trace->length * 1e9 / (now_ns() - start);
+
+    // A second replay times each operation and follows the free segments.
+    allocator = new_allocator_in(memory, policy, metadata, metadata_size);
+    report.malloc_latencies = malloc(trace->length * sizeof(uint64_t));
+    report.free_latencies = malloc(trace->length * sizeof(uint64_t));
+    unsigned int live_blocks = 0;
+    double fragmentation_sum = 0;
+    for (unsigned int i = 0; i < trace->length; i++) {
+        const struct Op *op = &trace->ops[i];
+        uint64_t before = now_ns();
+        if (op->kind == OP_MALLOC) {
+            addresses[op->slot] = block_malloc(&allocator, op->size);
+            report.malloc_latencies[report.malloc_count++] = now_ns() - before;
+            sizes[op->slot] = op->size;
+            live_blocks += op->size;
+        } else {
+            block_free(&allocator, addresses[op->slot]);
+            report.free_latencies[report.free_count++] = now_ns() - before;
+            live_blocks -= sizes[op->slot];
+        }
+        if (allocator.list.length > report.peak_segments) {
+            report.peak_segments = allocator.list.length;
+        }
+        // The memory is much bigger than the workloads, so the free segment
+        // at its end is left out. The external fragmentation is then the part
+        // of the memory below that segment which is free.
+        list_index top_index = find_ending_at(&allocator.list, MEMORY_LENGTH);
+        unsigned int footprint =
+            (top_index == LIST_INDEX_NONE)
+                ? MEMORY_LENGTH
+                : get_link(&allocator.list, top_index)->segment.start;
+        if (footprint > 0) {
+            fragmentation_sum += 1.0 - (double)live_blocks / footprint;
+        }
+    }
+    report.fragmentation = fragmentation_sum / trace->length;
+    free(metadata);
+    return report;
+}
+
+// Prints a line of results.
+void print_report(const struct Trace *trace, enum AllocationPolicy policy,
+                  struct Report *report) {
+    qsort(report->malloc_latencies, report->malloc_count, sizeof(uint64_t),
+          compare_latencies);
+    qsort(report->free_latencies, report->free_count, sizeof(uint64_t),
+          compare_latencies);
+    printf("%-18s %-10s %9.2f %6llu/%6llu/%7llu %6llu/%6llu/%7llu %8u "
+           "%5.1f%%\n",
+           trace->name, policy_names[policy], report->ops_per_second / 1e6,
+           percentile(report->malloc_latencies, report->malloc_count, 500),
+           percentile(report->malloc_latencies, report->malloc_count, 990),
+           percentile(report->malloc_latencies, report->malloc_count, 999),
+           percentile(report->free_latencies, report->free_count, 500),
+           percentile(report->free_latencies, report->free_count, 990),
+           percentile(report->free_latencies, report->free_count, 999),
+           report->peak_segments, 100 * report->fragmentation);
+}
+
+// Releases the latencies of a report.
+void report_destroy(struct Report *report) {
+    free(report->malloc_latencies);
+    free(report->free_latencies);
+}
+
+// Returns the current time in nanoseconds.
+uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec;
+}
+
+// Returns the next pseudo-random number of a xorshift generator.
+unsigned int next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// Compares two latencies for qsort.
+int compare_latencies(const void *a, const void *b) {
+    uint64_t latency_a = *(const uint64_t *)a;
+    uint64_t latency_b = *(const uint64_t *)b;
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+// Returns the latency at the given percentile, in tenths of a percent, of
+// sorted latencies.
+unsigned long long percentile(const uint64_t *latencies, unsigned int count,
+                              unsigned int permille) {
+    if (count == 0) {
+        return 0;
+    }
+    return latencies[(unsigned long long)(count - 1) * permille / 1000];
+}
+
+/************************************ EOF *************************************/
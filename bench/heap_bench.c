@@ -0,0 +1,127 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The front end being measured.
+#include "heap.h"
+
+// Used for printf.
+#include <stdio.h>
+
+// Used for the metadata buffer and rand.
+#include <stdlib.h>
+
+// Used to touch the allocated pages.
+#include <string.h>
+
+// Used for the size of the pages.
+#include <unistd.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of bytes of each block.
+#define BLOCK_SIZE 64
+
+// The number of blocks of the mapped memory, 128 MiB in total.
+#define MEMORY_BLOCKS (2u << 20)
+
+// The number of allocations at the peak of the load.
+#define PEAK_ALLOCATIONS 1536
+
+// The number of allocations left once the load drops.
+#define LOW_ALLOCATIONS 32
+
+// The biggest size allocated during the benchmark, in bytes.
+#define MAX_BYTES (128u << 10)
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the resident set size of the process in bytes.
+size_t resident_bytes(void);
+
+// Runs the load against a mapped Heap, giving the pages of large free segments
+// back when release is set, and prints the resident set sizes.
+int run(int release);
+
+/************************************ MAIN ************************************/
+
+int main(int argc, char const *argv[]) {
+    printf("%-10s %12s %12s\n", "release", "peak MiB", "low MiB");
+    // The same load is applied without and with the release of the pages.
+    if (run(0) || run(1)) {
+        return 1;
+    }
+    return 0;
+}
+
+/********************************* FUNCTIONS **********************************/
+
+// Returns the resident set size of the process in bytes.
+size_t resident_bytes(void) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) {
+        return 0;
+    }
+    // The second field is the number of resident pages.
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Runs the load against a mapped Heap, giving the pages of large free segments
+// back when release is set, and prints the resident set sizes.
+int run(int release) {
+    const struct Segment memory = {.start = 0, .length = MEMORY_BLOCKS};
+    size_t metadata_size = allocator_metadata_size(2 * PEAK_ALLOCATIONS);
+    void *metadata = malloc(metadata_size);
+    struct Allocator allocator =
+        new_allocator_in(memory, SEGREGATED_FIT, metadata, metadata_size);
+    struct Heap heap;
+    if (!map_heap(&heap, &allocator, BLOCK_SIZE, 0)) {
+        fprintf(stderr, "Could not map the memory of the heap.\n");
+        free(metadata);
+        return 1;
+    }
+    if (!release) {
+        heap_release_above(&heap, 0);
+    }
+    size_t baseline = resident_bytes();
+    // The load rises, every allocated byte being written to.
+    static void *allocations[PEAK_ALLOCATIONS];
+    srand(2021);
+    for (unsigned int index = 0; index < PEAK_ALLOCATIONS; index++) {
+        size_t bytes = 1 + rand() % MAX_BYTES;
+        allocations[index] = heap_malloc(&heap, bytes);
+        if (allocations[index] == NULL) {
+            fprintf(stderr, "The heap ran out of memory.\n");
+            return 1;
+        }
+        memset(allocations[index], 0xa5, bytes);
+    }
+    size_t peak = resident_bytes() - baseline;
+    // The load drops, only a few allocations scattered across the memory stay.
+    for (unsigned int index = 0; index < PEAK_ALLOCATIONS; index++) {
+        if (index % (PEAK_ALLOCATIONS / LOW_ALLOCATIONS) != 0) {
+            heap_free(&heap, allocations[index]);
+        }
+    }
+    size_t low = resident_bytes() - baseline;
+    printf("%-10s %12.1f %12.1f\n", release ? "on" : "off",
+           peak / 1048576.0, low / 1048576.0);
+    unmap_heap(&heap);
+    free(metadata);
+    return 0;
+}
+
+/************************************ EOF *************************************/
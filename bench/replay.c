@@ -0,0 +1,537 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The engines the traces are replayed against.
+#include "allocator.h"
+#include "deferred_allocator.h"
+#include "dense_allocator.h"
+#include "tlsf_allocator.h"
+
+// Used to read the recorded traces.
+#include "trace.h"
+
+// Used for printf.
+#include <stdio.h>
+
+// Used for the engines and the address maps.
+#include <stdlib.h>
+
+// Used to move the address maps along with a compaction.
+#include <string.h>
+
+// Used to time the replays.
+#include <time.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of calls of the demo trace recorded when no trace is given.
+#define DEMO_CALLS 1000000
+
+// The number of live allocations of the demo trace.
+#define DEMO_LIVE 4096
+
+// The number of calls between two compactions of the demo trace.
+#define DEMO_COMPACT_PERIOD (DEMO_CALLS / 4)
+
+// The number of frees of the churn trace, each followed by an allocation of the
+// same size.
+#define CHURN_CALLS 1000000
+
+// The number of live allocations of the churn trace.
+#define CHURN_LIVE 1000
+
+/********************************** STRUCTS ***********************************/
+
+// The calls of an allocation engine, so that a trace can drive any of them.
+struct Engine {
+    const char *name; // The name printed in the results.
+    // Sets up the engine over the given memory, for up to capacity live
+    // allocations.
+    void *(*create)(const struct Segment memory, unsigned int capacity);
+    // Releases the engine.
+    void (*destroy)(void *engine);
+    // Allocates size blocks at a multiple of alignment.
+    block_ptr (*malloc)(void *engine, unsigned int size,
+                        unsigned int alignment);
+    // Frees an allocation.
+    void (*free)(void *engine, block_ptr allocated);
+    // Resizes an allocation, or NULL to allocate a new one and free the former.
+    block_ptr (*realloc)(void *engine, block_ptr allocated, unsigned int size);
+};
+
+// An Allocator along with its metadata buffer.
+struct AllocatorEngine {
+    struct Allocator allocator; // The allocator.
+    void *metadata;             // Its metadata buffer.
+};
+
+// A DeferredAllocator along with its parent and the metadata buffer of the
+// latter.
+struct DeferredEngine {
+    struct Allocator allocator;        // The parent.
+    struct DeferredAllocator deferred; // The allocator.
+    void *metadata;                    // The metadata buffer of the parent.
+};
+
+// A DenseAllocator along with its metadata buffer.
+struct DenseEngine {
+    struct DenseAllocator dense; // The allocator.
+    void *metadata;              // Its metadata buffer.
+};
+
+// A TlsfAllocator along with its metadata buffer.
+struct TlsfEngine {
+    struct TlsfAllocator tlsf; // The allocator.
+    void *metadata;            // Its metadata buffer.
+};
+
+/********************************* PROTOYPES **********************************/
+
+// Records a demo trace of random allocations at the given path.
+int record_demo(const char *path);
+
+// Records a trace at the given path where allocations of a few small sizes are
+// freed and allocated again with the same size.
+int record_churn(const char *path);
+
+// Replays a mapped trace against an engine and prints the number of calls per
+// second.
+void replay(const struct MappedTrace *trace, const struct Engine *engine);
+
+// Returns the highest number of live allocations of a trace.
+unsigned int peak_live(const struct MappedTrace *trace);
+
+// Returns where an address went during a compaction, given the runs that moved
+// sorted by address.
+block_ptr compacted(const struct Relocation *relocations, unsigned int count,
+                    block_ptr address);
+
+// Returns the current time in nanoseconds.
+uint64_t now_ns(void);
+
+// Engine calls for the Allocator with each policy.
+void *create_segregated(const struct Segment memory, unsigned int capacity);
+void *create_first(const struct Segment memory, unsigned int capacity);
+void *create_next(const struct Segment memory, unsigned int capacity);
+void *create_best(const struct Segment memory, unsigned int capacity);
+void *create_worst(const struct Segment memory, unsigned int capacity);
+void *create_allocator(const struct Segment memory, unsigned int capacity,
+                       enum AllocationPolicy policy);
+void destroy_allocator(void *engine);
+block_ptr allocator_malloc(void *engine, unsigned int size,
+                           unsigned int alignment);
+void allocator_free(void *engine, block_ptr allocated);
+block_ptr allocator_realloc(void *engine, block_ptr allocated,
+                            unsigned int size);
+
+// Engine calls for the DeferredAllocator, which ignores the alignment.
+void *create_deferred(const struct Segment memory, unsigned int capacity);
+void destroy_deferred(void *engine);
+block_ptr deferred_engine_malloc(void *engine, unsigned int size,
+                                 unsigned int alignment);
+void deferred_engine_free(void *engine, block_ptr allocated);
+
+// Engine calls for the DenseAllocator, which ignores the alignment.
+void *create_dense(const struct Segment memory, unsigned int capacity);
+void destroy_dense(void *engine);
+block_ptr dense_engine_malloc(void *engine, unsigned int size,
+                              unsigned int alignment);
+void dense_engine_free(void *engine, block_ptr allocated);
+
+// Engine calls for the TlsfAllocator, which ignores the alignment.
+void *create_tlsf(const struct Segment memory, unsigned int capacity);
+void destroy_tlsf(void *engine);
+block_ptr tlsf_engine_malloc(void *engine, unsigned int size,
+                             unsigned int alignment);
+void tlsf_engine_free(void *engine, block_ptr allocated);
+
+/*********************************** GLOBALS **********************************/
+
+// The engines every trace is replayed against.
+static const struct Engine engines[] = {
+    {"segregated", create_segregated, destroy_allocator, allocator_malloc,
+     allocator_free, allocator_realloc},
+    {"first", create_first, destroy_allocator, allocator_malloc,
+     allocator_free, allocator_realloc},
+    {"next", create_next, destroy_allocator, allocator_malloc, allocator_free,
+     allocator_realloc},
+    {"best", create_best, destroy_allocator, allocator_malloc, allocator_free,
+     allocator_realloc},
+    {"worst", create_worst, destroy_allocator, allocator_malloc,
+     allocator_free, allocator_realloc},
+    {"deferred", create_deferred, destroy_deferred, deferred_engine_malloc,
+     deferred_engine_free, NULL},
+    {"dense", create_dense, destroy_dense, dense_engine_malloc,
+     dense_engine_free, NULL},
+    {"tlsf", create_tlsf, destroy_tlsf, tlsf_engine_malloc, tlsf_engine_free,
+     NULL},
+};
+
+/************************************ MAIN ************************************/
+
+int main(int argc, char **argv) {
+    const char *demo_paths[] = {"build/demo.trace", "build/churn.trace"};
+    int (*const demo_records[])(const char *) = {record_demo, record_churn};
+    const int demo_count = sizeof(demo_paths) / sizeof(demo_paths[0]);
+    if (argc < 2) {
+        // Without a trace, we record a few to have something to replay.
+        for (int i = 0; i < demo_count; i++) {
+            if (!demo_records[i](demo_paths[i])) {
+                fprintf(stderr, "Could not record %s\n", demo_paths[i]);
+                return 1;
+            }
+            printf("Recorded %s\n", demo_paths[i]);
+        }
+    }
+    for (int i = 0; i < ((argc < 2) ? demo_count : argc - 1); i++) {
+        const char *path = (argc < 2) ? demo_paths[i] : argv[i + 1];
+        struct MappedTrace trace;
+        if (!map_trace(&trace, path)) {
+            fprintf(stderr, "Could not map %s\n", path);
+            continue;
+        }
+        printf("%s: %zu calls\n", path, trace.length);
+        for (unsigned int j = 0; j < sizeof(engines) / sizeof(engines[0]);
+             j++) {
+            replay(&trace, &engines[j]);
+        }
+        unmap_trace(&trace);
+    }
+    return 0;
+}
+
+/********************************* FUNCTIONS **********************************/
+
+// Records a demo trace of random allocations at the given path.
+int record_demo(const char *path) {
+    static struct TraceRecorder recorder;
+    struct Segment memory = {.start = 0, .length = 1u << 24};
+    if (!open_trace_recorder(&recorder, path, memory)) {
+        return 0;
+    }
+    size_t metadata_size = allocator_metadata_size(2 * DEMO_LIVE);
+    void *metadata = malloc(metadata_size);
+    struct Allocator allocator =
+        new_allocator_in(memory, SEGREGATED_FIT, metadata, metadata_size);
+    allocator_record(&allocator, &recorder);
+
+    static block_ptr live[DEMO_LIVE];
+    static unsigned int sizes[DEMO_LIVE];
+    static struct Relocation relocations[2 * DEMO_LIVE];
+    for (unsigned int i = 0; i < DEMO_LIVE; i++) {
+        sizes[i] = 1 + rand() % 128;
+        live[i] = block_malloc(&allocator, sizes[i]);
+    }
+    for (unsigned int i = 0; i < DEMO_CALLS; i++) {
+        unsigned int victim = rand() % DEMO_LIVE;
+        if (rand() % 8 == 0) {
+            sizes[victim] = 1 + rand() % 128;
+            live[victim] =
+                block_realloc(&allocator, live[victim], sizes[victim]);
+        } else {
+            block_free(&allocator, live[victim]);
+            sizes[victim] = 1 + rand() % 128;
+            live[victim] = block_malloc(&allocator, sizes[victim]);
+        }
+        if ((i + 1) % DEMO_COMPACT_PERIOD == 0) {
+            // The trace also holds a few compactions, which move the live
+            // allocations.
+            unsigned int count = block_compact(&allocator, relocations);
+            for (unsigned int j = 0; j < DEMO_LIVE; j++) {
+                live[j] = compacted(relocations, count, live[j]);
+            }
+        }
+    }
+    for (unsigned int i = 0; i < DEMO_LIVE; i++) {
+        block_free(&allocator, live[i]);
+    }
+    close_trace_recorder(&recorder);
+    free(metadata);
+    return 1;
+}
+
+// Records a trace at the given path where allocations of a few small sizes are
+// freed and allocated again with the same size.
+int record_churn(const char *path) {
+    static struct TraceRecorder recorder;
+    struct Segment memory = {.start = 0, .length = 1u << 16};
+    if (!open_trace_recorder(&recorder, path, memory)) {
+        return 0;
+    }
+    size_t metadata_size = allocator_metadata_size(2 * CHURN_LIVE);
+    void *metadata = malloc(metadata_size);
+    struct Allocator allocator =
+        new_allocator_in(memory, SEGREGATED_FIT, metadata, metadata_size);
+    allocator_record(&allocator, &recorder);
+
+    // Each allocation keeps its size, so that a DeferredAllocator can hand the
+    // pending frees back as they are.
+    static block_ptr live[CHURN_LIVE];
+    for (unsigned int i = 0; i < CHURN_LIVE; i++) {
+        live[i] = block_malloc(&allocator, 4 + i % 4);
+    }
+    for (unsigned int i = 0; i < CHURN_CALLS; i++) {
+        unsigned int victim = rand() % CHURN_LIVE;
+        block_free(&allocator, live[victim]);
+        live[victim] = block_malloc(&allocator, 4 + victim % 4);
+    }
+    for (unsigned int i = 0; i < CHURN_LIVE; i++) {
+        block_free(&allocator, live[i]);
+    }
+    close_trace_recorder(&recorder);
+    free(metadata);
+    return 1;
+}
+
+// Replays a mapped trace against an engine and prints the number of calls per
+// second.
+void replay(const struct MappedTrace *trace, const struct Engine *engine) {
+    struct Segment memory = {.start = trace->header->memory_start,
+                             .length = trace->header->memory_length};
+    void *state = engine->create(memory, peak_live(trace) + 1);
+    // The recorded addresses are translated to the replayed ones through an
+    // array covering the recorded memory, whose untouched pages are never
+    // committed.
+    block_ptr *addresses = calloc(memory.length, sizeof(block_ptr));
+
+    // The engine may run out of memory where the recorded one did not, in
+    // which case the calls on the missing segment are skipped.
+    size_t failed = 0;
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < trace->length; i++) {
+        const struct TraceRecord *record = &trace->records[i];
+        block_ptr *replayed = &addresses[record->address - memory.start];
+        switch (record->op) {
+        case TRACE_MALLOC:
+            *replayed = engine->malloc(state, record->size, record->argument);
+            failed += (*replayed == BLOCK_PTR_NONE);
+            break;
+        case TRACE_FREE:
+            if (*replayed != BLOCK_PTR_NONE) {
+                engine->free(state, *replayed);
+            }
+            break;
+        case TRACE_REALLOC: {
+            block_ptr moved;
+            if (*replayed == BLOCK_PTR_NONE) {
+                moved = engine->malloc(state, record->size, 1);
+            } else if (engine->realloc != NULL) {
+                moved = engine->realloc(state, *replayed, record->size);
+            } else {
+                moved = engine->malloc(state, record->size, 1);
+                if (moved != BLOCK_PTR_NONE) {
+                    engine->free(state, *replayed);
+                }
+            }
+            if (moved == BLOCK_PTR_NONE) {
+                // The former segment is kept, under its recorded address.
+                failed++;
+                moved = *replayed;
+            }
+            *replayed = BLOCK_PTR_NONE;
+            addresses[record->argument - memory.start] = moved;
+            break;
+        }
+        case TRACE_COMPACT:
+            // The engine does not need to compact, the segments of the run are
+            // just known under their new recorded addresses. The runs come by
+            // increasing address and move down, so they never overwrite one
+            // another.
+            memmove(&addresses[record->argument - memory.start], replayed,
+                    record->size * sizeof(block_ptr));
+            break;
+        default:
+            break;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    printf("  %-12s %8.2f M calls/s %8zu failed\n", engine->name,
+           trace->length * 1e3 / (elapsed ? elapsed : 1), failed);
+    free(addresses);
+    engine->destroy(state);
+}
+
+// Returns the highest number of live allocations of a trace.
+unsigned int peak_live(const struct MappedTrace *trace) {
+    unsigned int live = 0;
+    unsigned int peak = 0;
+    for (size_t i = 0; i < trace->length; i++) {
+        if (trace->records[i].op == TRACE_MALLOC) {
+            live++;
+        } else if (trace->records[i].op == TRACE_FREE) {
+            live--;
+        }
+        if (live > peak) {
+            peak = live;
+        }
+    }
+    return peak;
+}
+
+// Returns where an address went during a compaction, given the runs that moved
+// sorted by address.
+block_ptr compacted(const struct Relocation *relocations, unsigned int count,
+                    block_ptr address) {
+    // We look for the last run starting at or before the address.
+    unsigned int lowest = 0;
+    unsigned int highest = count;
+    while (lowest < highest) {
+        unsigned int middle = lowest + (highest - lowest) / 2;
+        if (relocations[middle].from <= address) {
+            lowest = middle + 1;
+        } else {
+            highest = middle;
+        }
+    }
+    if (lowest == 0) {
+        // The address comes before all the runs, it did not move.
+        return address;
+    }
+    const struct Relocation *run = &relocations[lowest - 1];
+    return address - (run->from - run->to);
+}
+
+// Returns the current time in nanoseconds.
+uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec;
+}
+
+// Engine calls for the Allocator with each policy.
+void *create_segregated(const struct Segment memory, unsigned int capacity) {
+    return create_allocator(memory, capacity, SEGREGATED_FIT);
+}
+
+void *create_first(const struct Segment memory, unsigned int capacity) {
+    return create_allocator(memory, capacity, FIRST_FIT);
+}
+
+void *create_next(const struct Segment memory, unsigned int capacity) {
+    return create_allocator(memory, capacity, NEXT_FIT);
+}
+
+void *create_best(const struct Segment memory, unsigned int capacity) {
+    return create_allocator(memory, capacity, BEST_FIT);
+}
+
+void *create_worst(const struct Segment memory, unsigned int capacity) {
+    return create_allocator(memory, capacity, WORST_FIT);
+}
+
+void *create_allocator(const struct Segment memory, unsigned int capacity,
+                       enum AllocationPolicy policy) {
+    struct AllocatorEngine *engine = malloc(sizeof(struct AllocatorEngine));
+    // The free segments may outnumber the live allocations by one.
+    size_t metadata_size = allocator_metadata_size(capacity + 1);
+    engine->metadata = malloc(metadata_size);
+    engine->allocator =
+        new_allocator_in(memory, policy, engine->metadata, metadata_size);
+    return engine;
+}
+
+void destroy_allocator(void *engine) {
+    free(((struct AllocatorEngine *)engine)->metadata);
+    free(engine);
+}
+
+block_ptr allocator_malloc(void *engine, unsigned int size,
+                           unsigned int alignment) {
+    return block_malloc_aligned(&((struct AllocatorEngine *)engine)->allocator,
+                                size, alignment);
+}
+
+void allocator_free(void *engine, block_ptr allocated) {
+    block_free(&((struct AllocatorEngine *)engine)->allocator, allocated);
+}
+
+block_ptr allocator_realloc(void *engine, block_ptr allocated,
+                            unsigned int size) {
+    return block_realloc(&((struct AllocatorEngine *)engine)->allocator,
+                         allocated, size);
+}
+
+// Engine calls for the DeferredAllocator, which ignores the alignment.
+void *create_deferred(const struct Segment memory, unsigned int capacity) {
+    struct DeferredEngine *engine = malloc(sizeof(struct DeferredEngine));
+    // The pending frees stay allocated in the parent.
+    size_t metadata_size =
+        allocator_metadata_size(capacity + DEFERRED_PENDING_LEN + 1);
+    engine->metadata = malloc(metadata_size);
+    engine->allocator = new_allocator_in(memory, SEGREGATED_FIT,
+                                         engine->metadata, metadata_size);
+    engine->deferred =
+        new_deferred_allocator(&engine->allocator, DEFERRED_PENDING_LEN);
+    return engine;
+}
+
+void destroy_deferred(void *engine) {
+    free(((struct DeferredEngine *)engine)->metadata);
+    free(engine);
+}
+
+block_ptr deferred_engine_malloc(void *engine, unsigned int size,
+                                 unsigned int alignment) {
+    return deferred_malloc(&((struct DeferredEngine *)engine)->deferred, size);
+}
+
+void deferred_engine_free(void *engine, block_ptr allocated) {
+    deferred_free(&((struct DeferredEngine *)engine)->deferred, allocated);
+}
+
+// Engine calls for the DenseAllocator, which ignores the alignment.
+void *create_dense(const struct Segment memory, unsigned int capacity) {
+    struct DenseEngine *engine = malloc(sizeof(struct DenseEngine));
+    size_t metadata_size = dense_metadata_size(capacity);
+    engine->metadata = malloc(metadata_size);
+    engine->dense =
+        new_dense_allocator(memory, capacity, engine->metadata, metadata_size);
+    return engine;
+}
+
+void destroy_dense(void *engine) {
+    free(((struct DenseEngine *)engine)->metadata);
+    free(engine);
+}
+
+block_ptr dense_engine_malloc(void *engine, unsigned int size,
+                              unsigned int alignment) {
+    return dense_malloc(&((struct DenseEngine *)engine)->dense, size);
+}
+
+void dense_engine_free(void *engine, block_ptr allocated) {
+    dense_free(&((struct DenseEngine *)engine)->dense, allocated);
+}
+
+// Engine calls for the TlsfAllocator, which ignores the alignment.
+void *create_tlsf(const struct Segment memory, unsigned int capacity) {
+    struct TlsfEngine *engine = malloc(sizeof(struct TlsfEngine));
+    size_t metadata_size = tlsf_metadata_size(memory.length);
+    engine->metadata = malloc(metadata_size);
+    engine->tlsf = new_tlsf_allocator(memory, engine->metadata, metadata_size);
+    return engine;
+}
+
+void destroy_tlsf(void *engine) {
+    free(((struct TlsfEngine *)engine)->metadata);
+    free(engine);
+}
+
+block_ptr tlsf_engine_malloc(void *engine, unsigned int size,
+                             unsigned int alignment) {
+    return tlsf_malloc(&((struct TlsfEngine *)engine)->tlsf, size);
+}
+
+void tlsf_engine_free(void *engine, block_ptr allocated) {
+    tlsf_free(&((struct TlsfEngine *)engine)->tlsf, allocated);
+}
+
+/************************************ EOF *************************************/
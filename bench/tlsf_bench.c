@@ -0,0 +1,249 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The engines we want to compare.
+#include "allocator.h"
+#include "tlsf_allocator.h"
+
+// Used for printf.
+#include <stdio.h>
+
+// Used for the metadata buffers and qsort.
+#include <stdlib.h>
+
+// Used to time each operation.
+#include <time.h>
+
+// Used for the latencies.
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of timed allocations for each number of free segments.
+#define SAMPLES 200000
+
+// The biggest size allocated during the benchmark.
+#define MAX_SIZE 16
+
+// The smallest and biggest number of free segments, the number growing fourfold
+// at each step.
+#define MIN_FREE_SEGMENTS 256
+#define MAX_FREE_SEGMENTS 65536
+
+/********************************** STRUCTS ***********************************/
+
+// The engines being compared.
+enum Engine {
+    TLSF,                  // The TlsfAllocator.
+    SEGREGATED_FIT_ENGINE, // The Allocator with its default policy.
+    FIRST_FIT_ENGINE,      // The Allocator with the first fit policy.
+    ENGINE_COUNT,
+};
+
+// A memory being fragmented and measured with one of the engines.
+struct Bench {
+    enum Engine engine;         // The engine used.
+    struct TlsfAllocator tlsf;  // Used by the TLSF engine.
+    struct Allocator allocator; // Used by the other engines.
+    void *metadata;             // The metadata buffer of the engine.
+};
+
+/********************************* PROTOYPES **********************************/
+
+// Sets up an engine over the given memory, with enough metadata for the given
+// number of live allocations.
+void bench_init(struct Bench *bench, enum Engine engine,
+                const struct Segment memory, unsigned int capacity);
+
+// Releases the metadata buffer of an engine.
+void bench_destroy(struct Bench *bench);
+
+// Allocates with the engine of the benchmark.
+block_ptr bench_malloc(struct Bench *bench, unsigned int size);
+
+// Frees with the engine of the benchmark.
+void bench_free(struct Bench *bench, block_ptr allocated);
+
+// Fragments the memory into free_segments free segments, then times SAMPLES
+// allocations, frees and rejected allocations and prints their latency
+// percentiles.
+void measure(enum Engine engine, unsigned int free_segments);
+
+// Returns the current time in nanoseconds.
+uint64_t now_ns(void);
+
+// Returns the next pseudo-random number of a xorshift generator.
+unsigned int next_random(unsigned int *state);
+
+// Compares two latencies for qsort.
+int compare_latencies(const void *a, const void *b);
+
+// Prints the percentiles of sorted latencies.
+void print_percentiles(const uint64_t *latencies, unsigned int count);
+
+/************************************ MAIN ************************************/
+
+int main(int argc, char **argv) {
+    printf("%-16s %-10s %-6s %8s %8s %8s %10s\n", "engine", "free segs",
+           "op", "p50 ns", "p99 ns", "p99.99", "max ns");
+    for (unsigned int free_segments = MIN_FREE_SEGMENTS;
+         free_segments <= MAX_FREE_SEGMENTS; free_segments *= 4) {
+        for (enum Engine engine = TLSF; engine < ENGINE_COUNT; engine++) {
+            measure(engine, free_segments);
+        }
+    }
+    return 0;
+}
+
+/********************************* FUNCTIONS **********************************/
+
+// The names of the engines.
+static const char *engine_names[ENGINE_COUNT] = {"tlsf", "segregated fit",
+                                                 "first fit"};
+
+// Sets up an engine over the given memory, with enough metadata for the given
+// number of live allocations.
+void bench_init(struct Bench *bench, enum Engine engine,
+                const struct Segment memory, unsigned int capacity) {
+    bench->engine = engine;
+    if (engine == TLSF) {
+        size_t size = tlsf_metadata_size(memory.length);
+        bench->metadata = malloc(size);
+        bench->tlsf = new_tlsf_allocator(memory, bench->metadata, size);
+    } else {
+        size_t size = allocator_metadata_size(capacity);
+        bench->metadata = malloc(size);
+        bench->allocator = new_allocator_in(
+            memory, (engine == FIRST_FIT_ENGINE) ? FIRST_FIT : SEGREGATED_FIT,
+            bench->metadata, size);
+    }
+}
+
+// Releases the metadata buffer of an engine.
+void bench_destroy(struct Bench *bench) { free(bench->metadata); }
+
+// Allocates with the engine of the benchmark.
+block_ptr bench_malloc(struct Bench *bench, unsigned int size) {
+    if (bench->engine == TLSF) {
+        return tlsf_malloc(&bench->tlsf, size);
+    }
+    return block_malloc(&bench->allocator, size);
+}
+
+// Frees with the engine of the benchmark.
+void bench_free(struct Bench *bench, block_ptr allocated) {
+    if (bench->engine == TLSF) {
+        tlsf_free(&bench->tlsf, allocated);
+    } else {
+        block_free(&bench->allocator, allocated);
+    }
+}
+
+// Fragments the memory into free_segments free segments, then times SAMPLES
+// allocations, frees and rejected allocations and prints their latency
+// percentiles.
+void measure(enum Engine engine, unsigned int free_segments) {
+    unsigned int random_state = 2021;
+    // Every other segment of a first batch of allocations is freed, which
+    // leaves free segments that cannot be merged.
+    unsigned int count = 2 * free_segments;
+    struct Segment memory = {.start = 0, .length = count * MAX_SIZE + 1024};
+    struct Bench bench;
+    bench_init(&bench, engine, memory, count + 16);
+    block_ptr *live = malloc(count * sizeof(block_ptr));
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int size = 1 + next_random(&random_state) % MAX_SIZE;
+        live[i] = bench_malloc(&bench, size);
+    }
+    for (unsigned int i = 0; i < count; i += 2) {
+        bench_free(&bench, live[i]);
+    }
+
+    // Each allocation is freed right away, so that the number of free
+    // segments stays the same during the whole measure.
+    uint64_t *malloc_latencies = malloc(SAMPLES * sizeof(uint64_t));
+    uint64_t *free_latencies = malloc(SAMPLES * sizeof(uint64_t));
+    uint64_t *failed_latencies = malloc(SAMPLES * sizeof(uint64_t));
+    for (unsigned int i = 0; i < SAMPLES; i++) {
+        unsigned int size = 1 + next_random(&random_state) % MAX_SIZE;
+        uint64_t before = now_ns();
+        block_ptr allocated = bench_malloc(&bench, size);
+        uint64_t middle = now_ns();
+        bench_free(&bench, allocated);
+        uint64_t after = now_ns();
+        malloc_latencies[i] = middle - before;
+        free_latencies[i] = after - middle;
+    }
+    // Requests bigger than the whole memory are rejected, and should be as
+    // cheap as the successful ones.
+    for (unsigned int i = 0; i < SAMPLES; i++) {
+        uint64_t before = now_ns();
+        block_ptr allocated = bench_malloc(&bench, memory.length + 1);
+        failed_latencies[i] = now_ns() - before;
+        if (allocated != BLOCK_PTR_NONE) {
+            fprintf(stderr, "%s accepted an impossible request\n",
+                    engine_names[engine]);
+            bench_free(&bench, allocated);
+        }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%-16s %-10u", engine_names[engine],
+             free_segments);
+    qsort(malloc_latencies, SAMPLES, sizeof(uint64_t), compare_latencies);
+    qsort(free_latencies, SAMPLES, sizeof(uint64_t), compare_latencies);
+    printf("%s %-6s ", name, "malloc");
+    print_percentiles(malloc_latencies, SAMPLES);
+    printf("%s %-6s ", name, "free");
+    print_percentiles(free_latencies, SAMPLES);
+    qsort(failed_latencies, SAMPLES, sizeof(uint64_t), compare_latencies);
+    printf("%s %-6s ", name, "oom");
+    print_percentiles(failed_latencies, SAMPLES);
+
+    free(failed_latencies);
+    free(free_latencies);
+    free(malloc_latencies);
+    free(live);
+    bench_destroy(&bench);
+}
+
+// Returns the current time in nanoseconds.
+uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec;
+}
+
+// Returns the next pseudo-random number of a xorshift generator.
+unsigned int next_random(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Compares two latencies for qsort.
+int compare_latencies(const void *a, const void *b) {
+    uint64_t latency_a = *(const uint64_t *)a;
+    uint64_t latency_b = *(const uint64_t *)b;
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+// Prints the percentiles of sorted latencies.
+void print_percentiles(const uint64_t *latencies, unsigned int count) {
+    printf("%8llu %8llu %8llu %10llu\n",
+           (unsigned long long)latencies[count / 2],
+           (unsigned long long)latencies[(count - 1) * 99 / 100],
+           (unsigned long long)latencies[(unsigned int)((count - 1) * 0.9999)],
+           (unsigned long long)latencies[count - 1]);
+}
+
+/************************************ EOF *************************************/
@@ -16,32 +16,244 @@
 // Used for the CircularList structure.
 #include "circular_list.h"
 
+// Used to record the calls of an allocator.
+#include "trace.h"
+
+// Used for the fixed-width fields of the snapshots.
+#include <stdint.h>
+
 /*********************************** MACROS ***********************************/
 
 /* The macros definitions for your header go here */
 
+// The number of slots in the hash table of allocated segments when no metadata
+// buffer is provided. Must be a power of two, and should be at least twice the
+// expected number of live allocations to keep the lookups short.
+#ifndef ALLOCATOR_TABLE_LEN
+#define ALLOCATOR_TABLE_LEN (2 * CIRCULAR_LIST_MAX_LEN)
+#endif
+
+// Identifies a saved AllocatorSnapshot, "ASNP" in little endian.
+#define ALLOCATOR_SNAPSHOT_MAGIC 0x504e5341u
+
+// The version of the layout of the AllocatorSnapshot.
+#define ALLOCATOR_SNAPSHOT_VERSION 1
+
 /********************************** STRUCTS ***********************************/
 
-// The structure holding the state of the allocated memory.
+// The ways to choose which free segment an allocation is carved from.
+enum AllocationPolicy {
+    SEGREGATED_FIT, // The first big enough segment of the smallest size class.
+    FIRST_FIT,      // The big enough segment with the lowest address.
+    NEXT_FIT,       // The first big enough segment after the previous one.
+    BEST_FIT,       // The smallest big enough segment.
+    WORST_FIT,      // The biggest segment.
+};
+
+struct Allocator;
+
+// Called when an allocation of size blocks cannot be satisfied, before giving
+// up. The callback may free some segments, in which case the allocation is
+// tried again.
+typedef void (*low_memory_callback)(struct Allocator *allocator,
+                                    unsigned int size, void *context);
+
+// The structure holding the state of the allocated memory. Like for the
+// CircularList, the arrays either are part of the Allocator, in which case
+// their pointers are NULL, or live in a metadata buffer.
 struct Allocator {
     struct CircularList list; // The circular list with the available segments.
-    struct Segment allocated[CIRCULAR_LIST_MAX_LEN]; // The list of currently
-                                                     // allocated block.
-    char used[CIRCULAR_LIST_MAX_LEN]; // For each segment in the allocated
-                                      // array, whether it is used or not.
+    struct Segment memory;    // The whole memory handed out by the allocator.
+    struct Segment *allocated; // The currently allocated segments, in an open
+                               // addressing hash table keyed by their start.
+    bitmap_word *used; // For each segment in the allocated array, whether it is
+                       // used or not.
+    unsigned int table_len;       // The number of spots of the allocated array.
+    unsigned int capacity;        // How many allocations fit before moving to
+                                  // the spare metadata buffer.
+    unsigned int allocated_count; // The number of used spots.
+    enum AllocationPolicy policy; // How free segments are chosen.
+    void *spare_metadata;         // The buffer to move to once the metadata is
+                                  // full, or NULL.
+    size_t spare_size;            // The size of the spare buffer in bytes.
+    // Where the calls are recorded, or NULL.
+    struct TraceRecorder *recorder;
+    // Called when an allocation fails, or NULL.
+    low_memory_callback on_low_memory;
+    void *low_memory_context; // Passed to the callback.
+    unsigned long long malloc_calls;  // The number of allocations so far.
+    unsigned long long free_calls;    // The number of frees so far.
+    unsigned long long realloc_calls; // The number of resizes so far.
+    unsigned long long failed_calls;  // The number of failed allocations.
+    // The number of live allocations of each size class.
+    unsigned int size_histogram[CIRCULAR_LIST_BIN_COUNT];
+    // The arrays used when no metadata buffer is provided.
+    struct Segment inline_allocated[ALLOCATOR_TABLE_LEN];
+    bitmap_word inline_used[BITMAP_WORDS(ALLOCATOR_TABLE_LEN)];
+};
+
+// A run of contiguous allocated segments moved by block_compact.
+struct Relocation {
+    block_ptr from;      // The former start of the run.
+    block_ptr to;        // The new start of the run, below the former one.
+    unsigned int length; // The number of blocks of the run.
+};
+
+// The saved state of an Allocator, meant to be stored next to its metadata in
+// a memory-mapped file. Since block_ptr are offsets and the arrays are found
+// again from the metadata buffer, the state does not depend on where the file
+// is mapped.
+struct AllocatorSnapshot {
+    uint32_t magic;             // Always ALLOCATOR_SNAPSHOT_MAGIC.
+    uint32_t version;           // Always ALLOCATOR_SNAPSHOT_VERSION.
+    uint32_t state_size;        // The size of the Allocator structure of the
+                                // build that saved it.
+    uint32_t uses_metadata;     // Whether the arrays live in a metadata buffer,
+                                // or in the Allocator itself.
+    uint64_t metadata_size;     // The number of bytes of metadata in use.
+    uint64_t metadata_checksum; // The checksum of the metadata in use.
+    uint64_t checksum;          // The checksum of the rest of the snapshot.
+    struct Allocator state;     // The Allocator, without its pointers.
+};
+
+// A snapshot of the state of an Allocator, built from counters kept up to date
+// by the calls so that it is cheap enough to poll in production.
+struct AllocatorStats {
+    unsigned int free_blocks;          // The total length of the free segments.
+    unsigned int largest_free;         // The length of the biggest one.
+    unsigned int free_segments;        // The number of free segments.
+    unsigned int live_allocations;     // The number of allocated segments.
+    unsigned long long malloc_calls;   // The number of allocations so far.
+    unsigned long long free_calls;     // The number of frees so far.
+    unsigned long long realloc_calls;  // The number of resizes so far.
+    unsigned long long failed_calls;   // The number of failed allocations.
+    double visited_per_malloc;         // The average number of free segments
+                                       // looked at by each allocation.
+    // The number of live allocations of each size class, see size_class.
+    unsigned int size_histogram[CIRCULAR_LIST_BIN_COUNT];
 };
 
 /********************************* PROTOTYPES *********************************/
 
-// Well, malloc, but for blocks...
+// Well, malloc, but for blocks... Returns BLOCK_PTR_NONE for an empty request,
+// when no free segment is big enough, which requests bigger than largest_free
+// learn without any search, or when the allocator already holds as many
+// allocations as it has room for and no spare buffer to move to.
 block_ptr block_malloc(struct Allocator *allocator, unsigned int size);
 
+// Like block_malloc, but the returned address is a multiple of alignment,
+// which must be a power of two. The blocks skipped to reach the aligned address
+// stay free. Returns BLOCK_PTR_NONE when no free segment fits, or for the same
+// reasons as block_malloc.
+block_ptr block_malloc_aligned(struct Allocator *allocator, unsigned int size,
+                               unsigned int alignment);
+
 // free, but for blocks.
 void block_free(struct Allocator *allocator, block_ptr allocated);
 
+// Resizes an allocated segment and returns its address. The segment grows in
+// place into the free segment following it when possible. Otherwise it moves
+// to a new address, and the caller should copy its contents over before
+// allocating anything else. Returns BLOCK_PTR_NONE if the segment cannot grow,
+// or if its freed tail would need a link the full list does not have, in which
+// case it is left untouched.
+block_ptr block_realloc(struct Allocator *allocator, block_ptr allocated,
+                        unsigned int size);
+
+// Allocates count segments of the given size at once, writing their addresses
+// to out. The segments are carved from a single free segment when possible.
+// The addresses of the segments that could not be allocated are
+// BLOCK_PTR_NONE.
+void block_malloc_n(struct Allocator *allocator, unsigned int size,
+                    unsigned int count, block_ptr *out);
+
+// Frees count allocated segments at once. The array of addresses is sorted in
+// place, so that neighbouring segments are merged before going back to the
+// list.
+void block_free_n(struct Allocator *allocator, block_ptr *allocated,
+                  unsigned int count);
+
+// Slides all the allocated segments down to the start of the memory, so that
+// the free blocks end up in a single segment. The runs of segments that moved
+// are written to relocations by increasing address, and their number is
+// returned. The relocations array must hold as many entries as there are free
+// segments. Moving the contents of the runs in order with memmove is safe,
+// since each run only moves down. Any address held by the caller is stale
+// afterwards, see handle_table.h for addresses that survive.
+unsigned int block_compact(struct Allocator *allocator,
+                           struct Relocation *relocations);
+
+// Returns the number of blocks of an allocated segment.
+unsigned int block_size(const struct Allocator *allocator, block_ptr allocated);
+
+// Returns the number of live allocations.
+unsigned int live_allocations(const struct Allocator *allocator);
+
+// Returns the length of the biggest free segment, which is the biggest size
+// block_malloc can currently satisfy.
+unsigned int largest_free(const struct Allocator *allocator);
+
+// Returns the statistics of the allocator, in constant time.
+struct AllocatorStats allocator_stats(const struct Allocator *allocator);
+
+// Returns the allocated Segment at the given spot of the allocated array, or
+// NULL if the spot is free.
+const struct Segment *get_allocated(const struct Allocator *allocator,
+                                    unsigned int index);
+
 // Defines a new allocator..
 struct Allocator new_allocator(const struct Segment memory);
 
+// Defines a new allocator which chooses free segments with the given policy.
+struct Allocator new_allocator_with_policy(const struct Segment memory,
+                                           enum AllocationPolicy policy);
+
+// Defines a new allocator storing its state in the given metadata buffer, which
+// must be aligned on 8 bytes. The allocator can hold as many free segments and
+// live allocations as the buffer allows.
+struct Allocator new_allocator_in(const struct Segment memory,
+                                  enum AllocationPolicy policy, void *metadata,
+                                  size_t metadata_size);
+
+// Starts recording the calls of the allocator into the given recorder, or stops
+// recording them if it is NULL.
+void allocator_record(struct Allocator *allocator,
+                      struct TraceRecorder *recorder);
+
+// Sets the callback called when an allocation fails, or removes it if it is
+// NULL. The callback is given the allocator, the requested size and context.
+void allocator_on_low_memory(struct Allocator *allocator,
+                             low_memory_callback callback, void *context);
+
+// Saves the state of the allocator into a snapshot, in time proportional to its
+// metadata, which has to be saved alongside. The callback, the recorder and
+// the spare buffer are not saved.
+void allocator_save(const struct Allocator *allocator,
+                    struct AllocatorSnapshot *snapshot);
+
+// Sets up an allocator from a snapshot and the metadata buffer it was saved
+// with, wherever they are mapped now, in constant time. Returns 0 if the
+// snapshot is damaged, comes from an incompatible build, or the buffer is too
+// small. The metadata itself is not checked, see allocator_check_metadata.
+int allocator_attach(struct Allocator *allocator,
+                     const struct AllocatorSnapshot *snapshot, void *metadata,
+                     size_t metadata_size);
+
+// Returns whether the metadata buffer still holds what it held when the
+// snapshot was saved, in time proportional to its size.
+int allocator_check_metadata(const struct AllocatorSnapshot *snapshot,
+                             const void *metadata);
+
+// Returns the number of bytes of metadata an allocator needs to hold up to
+// capacity free segments and capacity live allocations.
+size_t allocator_metadata_size(unsigned int capacity);
+
+// Gives the allocator a bigger metadata buffer, aligned on 8 bytes, to move to
+// once it runs out of capacity. The current buffer can be reused after the
+// move, which is the case when the spare buffer is NULL again.
+void allocator_reserve(struct Allocator *allocator, void *metadata,
+                       size_t metadata_size);
+
 /* End of include once header guard */
 #endif
 
@@ -0,0 +1,57 @@
+/* Include once header guard */
+#ifndef BITMAP_HEADER_INCLUDED
+#define BITMAP_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the fixed-width words of the bitmap.
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of bits in a single word of a bitmap.
+#define BITMAP_WORD_BITS 64
+
+// The number of words needed to hold a bitmap of the given number of bits.
+#define BITMAP_WORDS(bits) (((bits) + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+
+/********************************** STRUCTS ***********************************/
+
+// A single word of a packed bitmap, a bitmap being an array of such words.
+typedef uint64_t bitmap_word;
+
+/********************************* PROTOTYPES *********************************/
+
+// Returns the value of the bit at the given index.
+int bitmap_get(const bitmap_word *bitmap, unsigned int index);
+
+// Sets the bit at the given index.
+void bitmap_set(bitmap_word *bitmap, unsigned int index);
+
+// Clears the bit at the given index.
+void bitmap_clear(bitmap_word *bitmap, unsigned int index);
+
+// Clears all the bits of a bitmap holding length bits.
+void bitmap_reset(bitmap_word *bitmap, unsigned int length);
+
+// Returns the index of the first clear bit at or after from, wrapping around at
+// the end of the bitmap. Returns length if all the bits are set.
+unsigned int bitmap_find_clear(const bitmap_word *bitmap, unsigned int length,
+                               unsigned int from);
+
+// Returns the number of bits set in a bitmap holding length bits.
+unsigned int bitmap_count(const bitmap_word *bitmap, unsigned int length);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
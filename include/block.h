@@ -19,6 +19,9 @@
 
 /* The macros definitions for your header go here */
 
+// Returned instead of an address when an allocation fails.
+#define BLOCK_PTR_NONE ((block_ptr)-1)
+
 /********************************** STRUCTS ***********************************/
 
 // We define the type of block_ptr to talk about the address of a block within
@@ -44,10 +47,21 @@ int are_contiguous(const struct Segment segmentA,
 struct Segment merge(const struct Segment segmentA,
                      const struct Segment segmentB);
 
+// Returns the home spot of an address in a hash table with the given number of
+// spots, which must be a power of two.
+unsigned int hash_of(block_ptr address, unsigned int table_len);
+
+// Returns the number of spots a hash table needs to hold count addresses with
+// short lookups, which is the smallest power of two at least twice count.
+unsigned int hash_len_for(unsigned int count);
+
 // Returns a subsegment of given size from within the provided one. Also resizes
 // the original segment.
 struct Segment extract_from(struct Segment *segment_ptr, unsigned int size);
 
+// Sorts an array of addresses in increasing order, in place.
+void sort_blocks(block_ptr *addresses, unsigned int count);
+
 /* End of include once header guard */
 #endif
 
@@ -0,0 +1,86 @@
+/* Include once header guard */
+#ifndef BUDDY_ALLOCATOR_HEADER_INCLUDED
+#define BUDDY_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Segment structure.
+#include "block.h"
+
+// Used to remember which blocks start a free or allocated segment.
+#include "bitmap.h"
+
+// Used for size_t.
+#include <stddef.h>
+
+/*********************************** MACROS ***********************************/
+
+// The order of the biggest segment of a BuddyAllocator. The orders have to fit
+// in the free mask, so at most 31.
+#ifndef BUDDY_MAX_ORDER
+#define BUDDY_MAX_ORDER 31
+#endif
+
+// Marks the end of a free list of a BuddyAllocator.
+#define BUDDY_NONE ((unsigned int)-1)
+
+/********************************** STRUCTS ***********************************/
+
+// An allocator only handing out segments of 2^k blocks, called order k
+// segments. A free segment of order k is split into two buddies of order k-1,
+// which are merged back once both are free again. The addresses are stored as
+// offsets from the start of the memory, so that the buddy of a segment is found
+// by flipping a single bit of its offset. The arrays indexed by offset live in
+// a metadata buffer provided by the caller.
+struct BuddyAllocator {
+    struct Segment memory;  // The memory managed by the allocator.
+    unsigned int free_mask; // Which orders have free segments.
+    unsigned int heads[BUDDY_MAX_ORDER + 1]; // The first free segment of each
+                                             // order, or BUDDY_NONE.
+    unsigned int *next;     // The following free segment of the same order.
+    unsigned int *previous; // The preceding free segment of the same order.
+    unsigned char *orders;  // The order of the segment starting at each
+                            // offset.
+    bitmap_word *free;      // Whether a free segment starts at each offset.
+    bitmap_word *used;      // Whether an allocated segment starts at each
+                            // offset.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Like block_malloc, the size is rounded up to the next power of two. Returns
+// BLOCK_PTR_NONE when no free segment is big enough.
+block_ptr buddy_malloc(struct BuddyAllocator *buddy, unsigned int size);
+
+// Like block_free, merging the segment with its buddies.
+void buddy_free(struct BuddyAllocator *buddy, block_ptr allocated);
+
+// Returns the number of blocks of an allocated segment, which is a power of
+// two.
+unsigned int buddy_size(const struct BuddyAllocator *buddy,
+                        block_ptr allocated);
+
+// Returns the number of bytes of metadata a BuddyAllocator needs to manage a
+// memory of the given number of blocks.
+size_t buddy_metadata_size(unsigned int length);
+
+// Defines a new BuddyAllocator storing its arrays in the given metadata buffer,
+// which must be aligned on 8 bytes and hold buddy_metadata_size(memory.length)
+// bytes. The length of the memory does not have to be a power of two.
+struct BuddyAllocator new_buddy_allocator(const struct Segment memory,
+                                          void *metadata,
+                                          size_t metadata_size);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
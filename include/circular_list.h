@@ -16,6 +16,12 @@
 // Holds the definition of a Segment and a block_ptr.
 #include "block.h"
 
+// Used to keep track of the used links.
+#include "bitmap.h"
+
+// Used for the size of metadata buffers.
+#include <stddef.h>
+
 /*********************************** MACROS ***********************************/
 
 /* The macros definitions for your header go here */
@@ -25,6 +31,27 @@
 #define CIRCULAR_LIST_MAX_LEN 32
 #endif
 
+// The number of size classes used to sort the free segments. Size class k
+// holds the segments whose length is in [2^k, 2^(k+1)[, so 32 classes are
+// enough for any unsigned int length.
+#define CIRCULAR_LIST_BIN_COUNT 32
+
+// The number of links of its own size class find_fit checks before asking the
+// tree, when no bigger size class has a link.
+#ifndef CIRCULAR_LIST_BIN_SCAN
+#define CIRCULAR_LIST_BIN_SCAN 8
+#endif
+
+// The number of spots in each of the hash tables finding links by their start
+// or end address. Must be a power of two, at least twice CIRCULAR_LIST_MAX_LEN
+// to keep the lookups short.
+#ifndef CIRCULAR_LIST_MAP_LEN
+#define CIRCULAR_LIST_MAP_LEN (2 * CIRCULAR_LIST_MAX_LEN)
+#endif
+
+// Marks the absence of a link, for instance at the end of a bin.
+#define LIST_INDEX_NONE ((list_index)-1)
+
 /********************************** STRUCTS ***********************************/
 
 // An index within the CircularList.
@@ -34,16 +61,41 @@ typedef unsigned int list_index;
 struct CircularLink {
     list_index next; // The pointer to the next element in the CircularList.
     struct Segment segment; // The Segment describing a block of free memory.
+    list_index bin_prev;    // The previous link in the same size class.
+    list_index bin_next;    // The next link in the same size class.
+    list_index tree_parent; // The parent of the link in the address tree.
+    list_index tree_left;   // The child of the link with lower addresses.
+    list_index tree_right;  // The child of the link with higher addresses.
+    unsigned int priority;  // The random heap priority of the link in the tree.
+    unsigned int max_length; // The longest Segment in the subtree of the link.
 };
 
-// Implementation of a fixed-size circular linked list.
+// Implementation of a fixed-size circular linked list. Its arrays either are
+// part of the CircularList itself, in which case their pointers are NULL, or
+// live in a metadata buffer provided by the caller.
 struct CircularList {
-    unsigned int length; // The number of used elements in the list.
-    list_index head;     // The index to a valid element in the CircularList.
-    struct CircularLink
-        links[CIRCULAR_LIST_MAX_LEN]; // The elements within the CircularList.
-    char used[CIRCULAR_LIST_MAX_LEN]; // For each index, whether it is free or
-                                      // used.
+    unsigned int length;   // The number of used elements in the list.
+    list_index head;       // The index to a valid element in the CircularList,
+                           // or LIST_INDEX_NONE once it is empty.
+    list_index rover;      // Where the next next-fit search starts.
+    unsigned int capacity; // The maximum number of elements in the list.
+    unsigned int map_len;  // The number of spots in each of the maps.
+    struct CircularLink *links; // The elements within the CircularList.
+    bitmap_word *used; // For each index, whether it is free or used.
+    list_index bins[CIRCULAR_LIST_BIN_COUNT]; // For each size class, the first
+                                              // link of that class.
+    unsigned int bin_mask; // Bit k is set when the size class k is not empty.
+    list_index tree_root;  // The root of the tree sorting the links by address.
+    unsigned int seed;     // The state used to draw the priorities of the tree.
+    list_index *start_map; // The links, in a hash table keyed by their start.
+    list_index *end_map;   // The links, in a hash table keyed by their end.
+    unsigned int free_blocks;   // The total length of the links.
+    unsigned long long visited; // The number of links visited by the searches.
+    // The arrays used when no metadata buffer is provided.
+    struct CircularLink inline_links[CIRCULAR_LIST_MAX_LEN];
+    bitmap_word inline_used[BITMAP_WORDS(CIRCULAR_LIST_MAX_LEN)];
+    list_index inline_start_map[CIRCULAR_LIST_MAP_LEN];
+    list_index inline_end_map[CIRCULAR_LIST_MAP_LEN];
 };
 
 /********************************* PROTOTYPES *********************************/
@@ -52,7 +104,8 @@ struct CircularList {
 // returns its index in the array.
 list_index insert_link(struct CircularList *list_ptr, struct CircularLink link);
 
-// Used to remove a block in the CircularList and return it.
+// Used to remove a block in the CircularList and return it. The list may be left
+// empty when all the memory is allocated.
 struct CircularLink remove_link(struct CircularList *list_ptr,
                                 list_index index);
 
@@ -63,9 +116,92 @@ struct CircularLink *next_link(struct CircularList *list,
 // Creates a new CircularList from a single Segment.
 struct CircularList new_list(const struct Segment segment);
 
+// Creates a new CircularList from a single Segment, storing up to capacity
+// links in the given metadata buffer of list_metadata_size(capacity) bytes.
+struct CircularList new_list_in(const struct Segment segment, void *metadata,
+                                unsigned int capacity);
+
+// Returns the number of bytes of metadata needed by a CircularList holding up
+// to capacity links.
+size_t list_metadata_size(unsigned int capacity);
+
+// Points the arrays of the list into a metadata buffer which already holds
+// them, such as one saved by a former process. The other fields of the list
+// should already be set.
+void attach_list(struct CircularList *list, void *metadata);
+
+// Empties the list but for a single link holding the given Segment, keeping
+// its storage and capacity.
+void reset_list(struct CircularList *list, const struct Segment segment);
+
+// Moves the links of the list to a new metadata buffer of
+// list_metadata_size(capacity) bytes. The capacity cannot shrink, and the
+// former buffer can be reused once this returns.
+void move_list_to(struct CircularList *list, void *metadata,
+                  unsigned int capacity);
+
 // Gets the head of the list.
 struct CircularLink *get_head(struct CircularList *list);
 
+// Gets the link at the given index.
+struct CircularLink *get_link(struct CircularList *list, list_index index);
+
+// Returns the size class of a segment with the given length.
+unsigned int size_class(unsigned int length);
+
+// Returns the index of a link holding at least size blocks, or LIST_INDEX_NONE
+// if there is none. The smallest size class whose links are all big enough is
+// searched first, in constant time.
+list_index find_fit(struct CircularList *list, unsigned int size);
+
+// Returns the index of the link with the lowest address holding at least size
+// blocks, or LIST_INDEX_NONE if there is none.
+list_index find_first_fit(struct CircularList *list, unsigned int size);
+
+// Returns the index of the first link holding at least size blocks, starting
+// from where the previous next-fit search stopped, or LIST_INDEX_NONE if there
+// is none.
+list_index find_next_fit(struct CircularList *list, unsigned int size);
+
+// Returns the index of the smallest link holding at least size blocks, or
+// LIST_INDEX_NONE if there is none.
+list_index find_best_fit(struct CircularList *list, unsigned int size);
+
+// Returns the index of the biggest link if it holds at least size blocks, or
+// LIST_INDEX_NONE otherwise.
+list_index find_worst_fit(struct CircularList *list, unsigned int size);
+
+// Returns the index of the link with the lowest address holding size blocks
+// starting at a multiple of alignment, which must be a power of two, or
+// LIST_INDEX_NONE if there is none.
+list_index find_aligned_fit(struct CircularList *list, unsigned int size,
+                            unsigned int alignment);
+
+// Returns the length of the longest Segment in the list.
+unsigned int longest_link(const struct CircularList *list);
+
+// Returns the index of the link with the highest start address below the given
+// address, or LIST_INDEX_NONE if there is none.
+list_index find_preceding(const struct CircularList *list, block_ptr address);
+
+// Returns the index of the link with the lowest start address at or above the
+// given address, or LIST_INDEX_NONE if there is none.
+list_index find_following(const struct CircularList *list, block_ptr address);
+
+// Returns the index of the link whose Segment starts at the given address, or
+// LIST_INDEX_NONE if there is none.
+list_index find_starting_at(const struct CircularList *list,
+                            block_ptr address);
+
+// Returns the index of the link whose Segment ends at the given address, or
+// LIST_INDEX_NONE if there is none.
+list_index find_ending_at(const struct CircularList *list, block_ptr address);
+
+// Replaces the Segment of the link at the given index, moving the link to the
+// right size class. The new Segment must keep the list sorted.
+void resize_link(struct CircularList *list, list_index index,
+                 const struct Segment segment);
+
 /* End of include once header guard */
 #endif
 
@@ -0,0 +1,93 @@
+/* Include once header guard */
+#ifndef CONCURRENT_ALLOCATOR_HEADER_INCLUDED
+#define CONCURRENT_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the shared Allocator.
+#include "allocator.h"
+
+// Used for the lock of the shared Allocator and the thread exit hook.
+#include <pthread.h>
+
+// Used for the map of cached segments, which is read without the lock.
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of size classes served by the thread caches. Size class k holds
+// segments of exactly 2^k blocks, bigger requests always take the lock.
+#ifndef CONCURRENT_CLASS_COUNT
+#define CONCURRENT_CLASS_COUNT 8
+#endif
+
+// The number of free segments each thread may keep for each size class.
+#ifndef CONCURRENT_CACHE_LEN
+#define CONCURRENT_CACHE_LEN 32
+#endif
+
+// The number of segments moved at once between a thread cache and the shared
+// Allocator.
+#ifndef CONCURRENT_BATCH_LEN
+#define CONCURRENT_BATCH_LEN 16
+#endif
+
+// The number of spots of the map of cached segments. Must be a power of two,
+// at most half of it is used.
+#ifndef CONCURRENT_MAP_LEN
+#define CONCURRENT_MAP_LEN (2 * ALLOCATOR_TABLE_LEN)
+#endif
+
+/********************************** STRUCTS ***********************************/
+
+// A thread-safe front end to an Allocator. Each thread keeps a few free
+// segments of each small size class, so that most calls do not take the lock.
+struct ConcurrentAllocator {
+    pthread_mutex_t lock;       // Protects the shared Allocator and the map.
+    struct Allocator allocator; // The shared Allocator.
+    pthread_key_t thread_key;   // Flushes the thread caches on thread exit.
+    unsigned int mapped;        // The number of used spots of the map.
+    _Atomic uint64_t class_map[CONCURRENT_MAP_LEN]; // The segments carved for
+                                                    // the thread caches, with
+                                                    // their start in the high
+                                                    // bits and their size
+                                                    // class + 1 in the low
+                                                    // bits. 0 for free spots.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Sets up a ConcurrentAllocator in place around an existing Allocator.
+void init_concurrent_allocator(struct ConcurrentAllocator *concurrent,
+                               const struct Allocator allocator);
+
+// Releases the resources of a ConcurrentAllocator. All the threads should have
+// called concurrent_flush or exited beforehand.
+void destroy_concurrent_allocator(struct ConcurrentAllocator *concurrent);
+
+// Thread-safe block_malloc, returning BLOCK_PTR_NONE when the memory is full.
+block_ptr concurrent_malloc(struct ConcurrentAllocator *concurrent,
+                            unsigned int size);
+
+// Thread-safe block_free.
+void concurrent_free(struct ConcurrentAllocator *concurrent,
+                     block_ptr allocated);
+
+// Gives the segments cached by the calling thread back to the shared
+// Allocator.
+void concurrent_flush(struct ConcurrentAllocator *concurrent);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
@@ -0,0 +1,66 @@
+/* Include once header guard */
+#ifndef DEFERRED_ALLOCATOR_HEADER_INCLUDED
+#define DEFERRED_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the parent Allocator.
+#include "allocator.h"
+
+/*********************************** MACROS ***********************************/
+
+// The maximum number of pending frees of a DeferredAllocator.
+#ifndef DEFERRED_PENDING_LEN
+#define DEFERRED_PENDING_LEN 64
+#endif
+
+/********************************** STRUCTS ***********************************/
+
+// Defers the frees of a parent Allocator. Freed segments are pushed to a
+// pending array and stay allocated in the parent, so that an allocation of the
+// same size can take one back without merging it into the free list and
+// splitting it again. The pending frees are sorted and merged in a single
+// sweep once there are threshold of them, or when the parent has no room left.
+struct DeferredAllocator {
+    struct Allocator *parent; // The Allocator the segments come from.
+    unsigned int threshold;   // The number of pending frees causing a sweep.
+    unsigned int count;       // The number of pending frees.
+    unsigned long long reuses; // The number of allocations served from the
+                               // pending frees.
+    block_ptr pending[DEFERRED_PENDING_LEN];       // The pending frees.
+    unsigned int pending_sizes[DEFERRED_PENDING_LEN]; // Their lengths.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Like block_malloc, taking back a pending free of the same size when there is
+// one. Such allocations are neither counted nor recorded by the parent.
+block_ptr deferred_malloc(struct DeferredAllocator *deferred,
+                          unsigned int size);
+
+// Like block_free, in constant time until the pending frees reach the
+// threshold.
+void deferred_free(struct DeferredAllocator *deferred, block_ptr allocated);
+
+// Gives all the pending frees back to the parent, merging them with their
+// neighbours in a single sorted sweep.
+void deferred_flush(struct DeferredAllocator *deferred);
+
+// Defines a new DeferredAllocator over the given parent, sweeping its pending
+// frees once there are threshold of them, at most DEFERRED_PENDING_LEN.
+struct DeferredAllocator new_deferred_allocator(struct Allocator *parent,
+                                                unsigned int threshold);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
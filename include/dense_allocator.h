@@ -0,0 +1,81 @@
+/* Include once header guard */
+#ifndef DENSE_ALLOCATOR_HEADER_INCLUDED
+#define DENSE_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Segment structure.
+#include "block.h"
+
+// Used for size_t.
+#include <stddef.h>
+
+/*********************************** MACROS ***********************************/
+
+/* The macros definitions for your header go here */
+
+/********************************** STRUCTS ***********************************/
+
+// A first fit allocator whose free segments are stored as a structure of
+// arrays sorted by address. The lengths of the free segments are contiguous,
+// so that the first fit is found by a linear scan comparing several lengths at
+// once with SIMD instructions, instead of following links through memory. The
+// allocated segments are kept in an open addressing hash table keyed by their
+// start. The arrays live in a metadata buffer provided by the caller, whose
+// size only depends on the number of live allocations.
+struct DenseAllocator {
+    struct Segment memory;     // The memory managed by the allocator.
+    unsigned int capacity;     // The maximum number of live allocations.
+    unsigned int length;       // The number of free segments.
+    unsigned int live;         // The number of live allocations.
+    unsigned int table_len;    // The number of spots of the allocated table.
+    unsigned int *lengths;     // The length of each free segment.
+    block_ptr *starts;         // The start of each free segment.
+    struct Segment *allocated; // The allocated segments, an empty spot having
+                               // a length of 0.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Like block_malloc, with a first fit search. Returns BLOCK_PTR_NONE when no
+// free segment is big enough or capacity allocations are live.
+block_ptr dense_malloc(struct DenseAllocator *dense, unsigned int size);
+
+// Like block_free, merging the segment with its neighbours.
+void dense_free(struct DenseAllocator *dense, block_ptr allocated);
+
+// Returns the number of blocks of an allocated segment.
+unsigned int dense_size(const struct DenseAllocator *dense,
+                        block_ptr allocated);
+
+// Returns the index of the first of count lengths which is at least size, or
+// count if there is none. Uses AVX2 or SSE2 when the compiler targets them.
+unsigned int dense_first_fit(const unsigned int *lengths, unsigned int count,
+                             unsigned int size);
+
+// Returns the number of bytes of metadata needed by a DenseAllocator holding up
+// to capacity live allocations.
+size_t dense_metadata_size(unsigned int capacity);
+
+// Defines a new DenseAllocator over the given memory, holding up to capacity
+// live allocations and storing its arrays in a metadata buffer of
+// dense_metadata_size(capacity) bytes. There are never more free segments than
+// live allocations plus one, which bounds the free arrays.
+struct DenseAllocator new_dense_allocator(const struct Segment memory,
+                                          unsigned int capacity,
+                                          void *metadata,
+                                          size_t metadata_size);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
@@ -0,0 +1,72 @@
+/* Include once header guard */
+#ifndef HANDLE_TABLE_HEADER_INCLUDED
+#define HANDLE_TABLE_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Allocator the segments come from.
+#include "allocator.h"
+
+/*********************************** MACROS ***********************************/
+
+// Returned instead of a handle when an allocation fails.
+#define BLOCK_HANDLE_NONE ((block_handle)-1)
+
+/********************************** STRUCTS ***********************************/
+
+// A stable name for an allocated segment, whose address may change when the
+// Allocator is compacted.
+typedef unsigned int block_handle;
+
+// Hands out handles to segments allocated from an Allocator. The arrays live
+// in a buffer provided by the caller, of handle_table_size(capacity) bytes.
+struct HandleTable {
+    struct Allocator *allocator; // The Allocator the segments come from.
+    block_ptr *addresses;        // The current address of each handle.
+    bitmap_word *used;           // Which handles are in use.
+    unsigned int capacity;       // The number of handles.
+    block_handle rover;          // Where the search for a free handle starts.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Allocates size blocks and returns their handle, or BLOCK_HANDLE_NONE if there
+// is no free handle or no room for the segment. A failed allocation may succeed
+// after handle_compact.
+block_handle handle_malloc(struct HandleTable *handles, unsigned int size);
+
+// Frees the segment of a handle, which can then be handed out again.
+void handle_free(struct HandleTable *handles, block_handle handle);
+
+// Returns the current address of the segment of a handle.
+block_ptr handle_resolve(const struct HandleTable *handles,
+                         block_handle handle);
+
+// Compacts the Allocator with block_compact and moves the addresses of the
+// handles along. The relocations are returned like for block_compact, for the
+// caller to move the contents of the segments.
+unsigned int handle_compact(struct HandleTable *handles,
+                            struct Relocation *relocations);
+
+// Returns the number of bytes of the buffer needed by a HandleTable of the
+// given capacity.
+size_t handle_table_size(unsigned int capacity);
+
+// Defines a new HandleTable of the given capacity over a buffer aligned on 8
+// bytes, for segments allocated from the given Allocator.
+struct HandleTable new_handle_table(struct Allocator *allocator, void *buffer,
+                                   unsigned int capacity);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
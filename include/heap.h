@@ -0,0 +1,88 @@
+/* Include once header guard */
+#ifndef HEAP_HEADER_INCLUDED
+#define HEAP_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Allocator handing out the blocks.
+#include "allocator.h"
+
+// Used for size_t.
+#include <stddef.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of bytes from which the free segments of a mapped Heap give their
+// pages back to the system.
+#ifndef HEAP_RELEASE_BYTES
+#define HEAP_RELEASE_BYTES (1u << 20)
+#endif
+
+/********************************** STRUCTS ***********************************/
+
+// Binds an Allocator to real memory, each block standing for block_size bytes,
+// so that it hands out pointers instead of block_ptr. The pointers are aligned
+// on the block size as long as the memory is.
+struct Heap {
+    struct Allocator *allocator; // The Allocator handing out the blocks.
+    unsigned char *base;         // The address of the first block.
+    size_t block_size;           // The number of bytes of each block.
+    size_t page_size;            // The size of the pages of the system.
+    unsigned int release_blocks; // The length from which a free segment gives
+                                 // its pages back to the system, or 0 never.
+    int mapped;                  // Whether the memory was mapped by map_heap.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Like malloc, over the blocks of the Allocator. Returns NULL when there is no
+// room left.
+void *heap_malloc(struct Heap *heap, size_t bytes);
+
+// Like free. The pages of a free segment of at least release_blocks blocks are
+// given back to the system.
+void heap_free(struct Heap *heap, void *pointer);
+
+// Like realloc, growing the segment in place when possible. Returns NULL when
+// there is no room left, in which case the former segment is left untouched.
+void *heap_realloc(struct Heap *heap, void *pointer, size_t bytes);
+
+// Returns the address of a block.
+void *heap_pointer(const struct Heap *heap, block_ptr block);
+
+// Returns the block at an address handed out by the Heap.
+block_ptr heap_block(const struct Heap *heap, const void *pointer);
+
+// Sets the number of bytes from which free segments give their pages back to
+// the system, or never if it is 0. Only meant for private anonymous memory,
+// whose released pages read as zeros afterwards.
+void heap_release_above(struct Heap *heap, size_t bytes);
+
+// Defines a new Heap over a buffer of the caller, holding as many blocks of
+// block_size bytes as the memory of the Allocator. No pages are released.
+struct Heap new_heap(struct Allocator *allocator, void *buffer,
+                     size_t block_size);
+
+// Sets up a Heap over a new anonymous mapping, holding as many blocks of
+// block_size bytes as the memory of the Allocator. Transparent huge pages are
+// asked for when huge_pages is set, and the free segments of at least
+// HEAP_RELEASE_BYTES give their pages back. Returns 0 if the mapping fails.
+int map_heap(struct Heap *heap, struct Allocator *allocator, size_t block_size,
+             int huge_pages);
+
+// Unmaps the memory of a Heap set up by map_heap.
+void unmap_heap(struct Heap *heap);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
@@ -0,0 +1,69 @@
+/* Include once header guard */
+#ifndef REGION_ALLOCATOR_HEADER_INCLUDED
+#define REGION_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the parent Allocator.
+#include "allocator.h"
+
+/*********************************** MACROS ***********************************/
+
+/* The macros definitions for your header go here */
+
+/********************************** STRUCTS ***********************************/
+
+// Hands out blocks by bumping an offset within a single region carved from a
+// parent Allocator. The blocks are never freed one by one, they all come back
+// at once when the region is reset. The region is only carved on the first
+// allocation, so that an idle RegionAllocator holds no memory.
+struct RegionAllocator {
+    struct Allocator *parent; // The Allocator the region is carved from.
+    unsigned int length;      // The number of blocks of the region.
+    block_ptr start;          // The start of the region, or BLOCK_PTR_NONE if
+                              // it is not carved yet.
+    unsigned int offset;      // The number of blocks handed out so far.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Returns size blocks from the region, carving it from the parent if needed, or
+// BLOCK_PTR_NONE if the region is full or cannot be carved.
+block_ptr region_malloc(struct RegionAllocator *region, unsigned int size);
+
+// Like region_malloc, but the returned address is a multiple of alignment,
+// which must be a power of two.
+block_ptr region_malloc_aligned(struct RegionAllocator *region,
+                                unsigned int size, unsigned int alignment);
+
+// Does nothing, the blocks of a region come back with region_release or
+// region_reset.
+void region_free(struct RegionAllocator *region, block_ptr allocated);
+
+// Returns a checkpoint of the region, to be given to region_release.
+unsigned int region_mark(const struct RegionAllocator *region);
+
+// Frees all the blocks handed out since the given checkpoint was taken.
+void region_release(struct RegionAllocator *region, unsigned int mark);
+
+// Frees all the blocks of the region at once, giving it back to the parent.
+void region_reset(struct RegionAllocator *region);
+
+// Defines a new RegionAllocator handing out up to length blocks from the given
+// parent Allocator.
+struct RegionAllocator new_region_allocator(struct Allocator *parent,
+                                            unsigned int length);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
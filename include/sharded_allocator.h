@@ -0,0 +1,74 @@
+/* Include once header guard */
+#ifndef SHARDED_ALLOCATOR_HEADER_INCLUDED
+#define SHARDED_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Allocator of each arena.
+#include "allocator.h"
+
+// Used for the lock of each arena.
+#include <pthread.h>
+
+/*********************************** MACROS ***********************************/
+
+// The maximum number of arenas of a ShardedAllocator.
+#ifndef SHARDED_MAX_ARENAS
+#define SHARDED_MAX_ARENAS 64
+#endif
+
+/********************************** STRUCTS ***********************************/
+
+// An independent part of the memory, with its own Allocator and lock.
+struct Arena {
+    pthread_mutex_t lock;       // Protects the Allocator of the arena.
+    struct Allocator allocator; // Manages the memory of the arena.
+    struct Segment memory;      // The part of the memory owned by the arena.
+};
+
+// A thread-safe allocator splitting the memory into arenas, each thread
+// allocating from its own arena first.
+struct ShardedAllocator {
+    unsigned int arena_count;   // The number of arenas in use.
+    block_ptr start;            // The start of the whole memory.
+    unsigned int arena_length;  // The length of each arena, except the last
+                                // one which also takes the remaining blocks.
+    struct Arena arenas[SHARDED_MAX_ARENAS]; // The arenas.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Sets up a ShardedAllocator in place, splitting the memory into arena_count
+// arenas. The metadata buffer, if not NULL, is shared evenly between the arenas
+// like for new_allocator_in. Otherwise each arena uses its own arrays.
+void init_sharded_allocator(struct ShardedAllocator *sharded,
+                            const struct Segment memory,
+                            unsigned int arena_count,
+                            enum AllocationPolicy policy, void *metadata,
+                            size_t metadata_size);
+
+// Releases the resources of a ShardedAllocator.
+void destroy_sharded_allocator(struct ShardedAllocator *sharded);
+
+// Thread-safe block_malloc, which tries the arena of the calling thread first
+// and then the other ones. Returns BLOCK_PTR_NONE when all of them are
+// exhausted.
+block_ptr sharded_malloc(struct ShardedAllocator *sharded, unsigned int size);
+
+// Thread-safe block_free, which gives the segment back to the arena it comes
+// from.
+void sharded_free(struct ShardedAllocator *sharded, block_ptr allocated);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
@@ -0,0 +1,90 @@
+/* Include once header guard */
+#ifndef SLAB_ALLOCATOR_HEADER_INCLUDED
+#define SLAB_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the parent Allocator.
+#include "allocator.h"
+
+/*********************************** MACROS ***********************************/
+
+// The number of blocks of the run carved for each slab, unless a single slot
+// is bigger.
+#ifndef SLAB_RUN_LEN
+#define SLAB_RUN_LEN 64
+#endif
+
+// The maximum number of slots of a slab, whose free slots are tracked by a
+// single bitmap word.
+#define SLAB_MAX_SLOTS BITMAP_WORD_BITS
+
+/********************************** STRUCTS ***********************************/
+
+// A run of blocks cut into slots of equal size.
+struct Slab {
+    block_ptr start;        // The start of the run.
+    bitmap_word free_slots; // Which slots of the run are free.
+};
+
+// Hands out slots of a single size from slabs carved from a parent Allocator.
+// Each run starts at a multiple of a power of two at least its length, so
+// that the start of the slab of a freed slot is found by masking its address,
+// and its index by looking that start up in an open addressing hash table. The
+// arrays live in a buffer provided by the caller, of slab_table_size(capacity)
+// bytes.
+struct SlabAllocator {
+    struct Allocator *parent;   // The Allocator the runs are carved from.
+    unsigned int slot_size;     // The number of blocks of each slot.
+    unsigned int slot_count;    // The number of slots of each slab.
+    unsigned int run_alignment; // The alignment of the runs, a power of two.
+    unsigned int slab_count;    // The number of slabs in use.
+    unsigned int capacity;      // The maximum number of slabs.
+    unsigned int empty_slabs;   // The number of slabs with no slot handed out,
+                                // at most one.
+    unsigned int table_len;     // The number of spots of the hash table.
+    bitmap_word *partial_slabs; // Which slabs have free slots.
+    struct Slab *slabs;         // The slabs, in no particular order.
+    unsigned int *table; // The indices of the slabs, in an open addressing
+                         // hash table keyed by their start, or capacity for
+                         // an empty spot.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Returns a free slot, carving a new slab from the parent if needed, or
+// BLOCK_PTR_NONE if no slab can be carved. The slabs with free slots are found
+// a bitmap word at a time.
+block_ptr slab_malloc(struct SlabAllocator *slab_allocator);
+
+// Gives a slot back to its slab, found in constant time. A single empty slab
+// is kept for the next allocations, the others go back to the parent.
+void slab_free(struct SlabAllocator *slab_allocator, block_ptr slot);
+
+// Returns the number of bytes of the buffer needed by a SlabAllocator holding
+// up to capacity slabs.
+size_t slab_table_size(unsigned int capacity);
+
+// Defines a new SlabAllocator handing out slots of slot_size blocks from the
+// given parent Allocator, holding up to capacity slabs in a buffer aligned on
+// 8 bytes.
+struct SlabAllocator new_slab_allocator(struct Allocator *parent,
+                                        unsigned int slot_size, void *buffer,
+                                        unsigned int capacity);
+
+// Gives all the slabs back to the parent, whether their slots are free or not.
+void destroy_slab_allocator(struct SlabAllocator *slab_allocator);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
@@ -0,0 +1,96 @@
+/* Include once header guard */
+#ifndef TLSF_ALLOCATOR_HEADER_INCLUDED
+#define TLSF_ALLOCATOR_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Segment structure.
+#include "block.h"
+
+// Used to remember which blocks start a free or allocated segment.
+#include "bitmap.h"
+
+// Used for size_t.
+#include <stddef.h>
+
+/*********************************** MACROS ***********************************/
+
+// Each first level range [2^k, 2^(k+1)[ is split into 2^TLSF_SL_LOG2 second
+// level ranges of equal width.
+#ifndef TLSF_SL_LOG2
+#define TLSF_SL_LOG2 4
+#endif
+
+// The number of second level ranges of each first level range.
+#define TLSF_SL_COUNT (1u << TLSF_SL_LOG2)
+
+// The number of first level ranges needed for any unsigned int length. The
+// lengths below TLSF_SL_COUNT all share the first one.
+#define TLSF_FL_COUNT (32 - TLSF_SL_LOG2 + 1)
+
+// Marks the end of a free list of a TlsfAllocator.
+#define TLSF_NONE ((unsigned int)-1)
+
+/********************************** STRUCTS ***********************************/
+
+// A Two-Level Segregated Fit allocator. The free segments are sorted into
+// ranges of lengths by two levels of bitmaps, which find a big enough free
+// segment in constant time. Instead of the headers and footers of the classic
+// design, the arrays are indexed by the offset of each block from the start of
+// the memory, so that the neighbours of a freed segment are found in constant
+// time as well.
+struct TlsfAllocator {
+    struct Segment memory;    // The memory managed by the allocator.
+    unsigned int first_level; // Which first level ranges have free segments.
+    unsigned int second_level[TLSF_FL_COUNT]; // Which second level ranges of
+                                              // each first level range have
+                                              // free segments.
+    unsigned int heads[TLSF_FL_COUNT][TLSF_SL_COUNT]; // The first free segment
+                                                      // of each range.
+    unsigned int free_count;  // The number of free segments.
+    unsigned int *lengths;    // The length of the segment starting at each
+                              // offset.
+    unsigned int *next;       // The following free segment of the same range.
+    unsigned int *previous;   // The preceding free segment of the same range.
+    unsigned int *starts;     // The start of the free segment ending at each
+                              // offset.
+    bitmap_word *free;        // Whether a free segment starts at each offset.
+    bitmap_word *used;        // Whether an allocated segment starts at each
+                              // offset.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Like block_malloc, but in constant time. Returns BLOCK_PTR_NONE when no free
+// segment is big enough.
+block_ptr tlsf_malloc(struct TlsfAllocator *tlsf, unsigned int size);
+
+// Like block_free, merging the segment with its neighbours in constant time.
+void tlsf_free(struct TlsfAllocator *tlsf, block_ptr allocated);
+
+// Returns the number of blocks of an allocated segment.
+unsigned int tlsf_size(const struct TlsfAllocator *tlsf, block_ptr allocated);
+
+// Returns the number of bytes of metadata a TlsfAllocator needs to manage a
+// memory of the given number of blocks.
+size_t tlsf_metadata_size(unsigned int length);
+
+// Defines a new TlsfAllocator storing its arrays in the given metadata buffer,
+// which must be aligned on 8 bytes and hold tlsf_metadata_size(memory.length)
+// bytes.
+struct TlsfAllocator new_tlsf_allocator(const struct Segment memory,
+                                        void *metadata, size_t metadata_size);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
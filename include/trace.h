@@ -0,0 +1,108 @@
+/* Include once header guard */
+#ifndef TRACE_HEADER_INCLUDED
+#define TRACE_HEADER_INCLUDED
+
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Header
+ */
+
+/********************************** INCLUDES **********************************/
+
+// Used for the Segment structure.
+#include "block.h"
+
+// Used for the fixed-width fields of the records.
+#include <stdint.h>
+
+// Used for size_t.
+#include <stddef.h>
+
+/*********************************** MACROS ***********************************/
+
+// The number of records buffered by a TraceRecorder before they are written.
+#ifndef TRACE_BUFFER_LEN
+#define TRACE_BUFFER_LEN 4096
+#endif
+
+// The first bytes of a trace file, "BLKT" in little endian.
+#define TRACE_MAGIC 0x544B4C42u
+
+// The version of the trace format.
+#define TRACE_VERSION 2
+
+/********************************** STRUCTS ***********************************/
+
+// The calls a trace records.
+enum TraceOp {
+    TRACE_MALLOC = 1,  // The argument is the alignment, 1 if none was asked.
+    TRACE_FREE = 2,    // The size and argument are 0.
+    TRACE_REALLOC = 3, // The argument is the new address.
+    TRACE_COMPACT = 4, // A run of block_compact. The address is where it was,
+                       // the argument where it moved and the size its length.
+};
+
+// The start of a trace file.
+struct TraceHeader {
+    uint32_t magic;         // TRACE_MAGIC.
+    uint32_t version;       // TRACE_VERSION.
+    uint32_t memory_start;  // The start of the memory of the allocator.
+    uint32_t memory_length; // The length of the memory of the allocator.
+};
+
+// A single call, as written to the trace file right after the header.
+struct TraceRecord {
+    uint32_t op;        // The TraceOp of the call.
+    uint32_t size;      // The number of blocks asked for.
+    uint32_t address;   // The address returned or freed.
+    uint32_t argument;  // Depends on the TraceOp.
+    uint64_t timestamp; // The time of the call in nanoseconds.
+};
+
+// Buffers the records of an allocator and writes them to a file in big chunks.
+struct TraceRecorder {
+    int file;            // The file descriptor.
+    unsigned int length; // The number of buffered records.
+    struct TraceRecord records[TRACE_BUFFER_LEN]; // The buffered records.
+};
+
+// A trace file mapped in memory, whose records can be read in place.
+struct MappedTrace {
+    const struct TraceHeader *header;  // The header of the file.
+    const struct TraceRecord *records; // The records following it.
+    size_t length;                     // The number of records.
+    size_t mapped_size;                // The size of the mapping in bytes.
+};
+
+/********************************* PROTOTYPES *********************************/
+
+// Creates the trace file at the given path for an allocator managing the given
+// memory. Returns 0 if the file could not be created.
+int open_trace_recorder(struct TraceRecorder *recorder, const char *path,
+                        const struct Segment memory);
+
+// Adds a record to the buffer, writing the buffer out once it is full.
+void trace_record(struct TraceRecorder *recorder, enum TraceOp op,
+                  unsigned int size, block_ptr address, unsigned int argument);
+
+// Writes the buffered records to the file.
+void flush_trace_recorder(struct TraceRecorder *recorder);
+
+// Writes the buffered records and closes the file.
+void close_trace_recorder(struct TraceRecorder *recorder);
+
+// Maps a trace file in memory. Returns 0 if the file could not be mapped or is
+// not a trace.
+int map_trace(struct MappedTrace *trace, const char *path);
+
+// Releases a mapped trace.
+void unmap_trace(struct MappedTrace *trace);
+
+/* End of include once header guard */
+#endif
+
+/************************************ EOF *************************************/
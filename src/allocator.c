@@ -15,16 +15,116 @@
 // For debugging purposes.
 #include <assert.h>
 
+// Used to check the alignment of metadata buffers.
+#include <stdint.h>
+
+// Used to copy the state of an allocator into a snapshot.
+#include <string.h>
+
+// Used to skip the checksum of a snapshot while computing it.
+#include <stddef.h>
+
+/*********************************** MACROS ***********************************/
+
+// The starting value of the FNV-1a hash used for the checksums.
+#define CHECKSUM_SEED 14695981039346656037ull
+
+// The lookups rely on the length of the table being a power of two.
+_Static_assert((ALLOCATOR_TABLE_LEN & (ALLOCATOR_TABLE_LEN - 1)) == 0,
+               "ALLOCATOR_TABLE_LEN must be a power of two");
+
 /********************************* PROTOYPES **********************************/
 
+// block_malloc, without recording the call.
+static block_ptr malloc_unrecorded(struct Allocator *allocator,
+                                   unsigned int size);
+
+// block_free, without recording the call.
+static void free_unrecorded(struct Allocator *allocator, block_ptr allocated);
+
+// Counts a call of the allocator, and records it if it is being recorded.
+static void record_call(struct Allocator *allocator, enum TraceOp op,
+                        unsigned int size, block_ptr address,
+                        unsigned int argument);
+
+// Returns the index of the free link an allocation of the given size should be
+// carved from according to the policy of the allocator.
+static list_index find_link(struct Allocator *allocator, unsigned int size);
+
+// Returns the index of a free link holding an aligned range of size blocks, or
+// LIST_INDEX_NONE without searching when size is bigger than any free segment.
+static list_index find_aligned_link(struct Allocator *allocator,
+                                    unsigned int size, unsigned int alignment);
+
+// Calls the low memory callback of the allocator, if any.
+static void low_memory(struct Allocator *allocator, unsigned int size);
+
 // Returns the index of the memory Segment with information on the allocated
 // memory block.
 static unsigned int get_segment_index(const struct Allocator *allocator,
                                       block_ptr allocated);
 
-// Returns the index of the first free spot to put an allocated segment within
-// the allocator.
-static unsigned int first_free(const struct Allocator *allocator);
+// Returns the index of the first free spot to put an allocated segment
+// starting at the given address within the allocator.
+static unsigned int first_free(const struct Allocator *allocator,
+                               block_ptr allocated);
+
+// Returns the spot of the allocated array where the search for a segment
+// starting at the given address begins.
+static unsigned int home_of(const struct Allocator *allocator,
+                            block_ptr allocated);
+
+// Removes the allocated segment at the given index from the allocated array,
+// keeping the following segments reachable from their home spot.
+static void release_index(struct Allocator *allocator, unsigned int index);
+
+// Changes the length of an allocated Segment in place.
+static void resize_allocated(struct Allocator *allocator,
+                             struct Segment *allocated_segment,
+                             unsigned int length);
+
+// Sets the statistics counters of a new allocator to 0.
+static void reset_counters(struct Allocator *allocator);
+
+// Returns whether count more allocated segments fit in the allocator, moving
+// to the spare metadata buffer if needed.
+static int has_room(struct Allocator *allocator, unsigned int count);
+
+// Returns whether one more link fits in the free list, moving to the spare
+// metadata buffer if needed.
+static int has_free_link(struct Allocator *allocator);
+
+// Adds an allocated Segment to the allocated array.
+static void record_segment(struct Allocator *allocator,
+                           const struct Segment segment);
+
+// Gives a Segment back to the free segments, merging it with its neighbours.
+static void release_segment(struct Allocator *allocator,
+                            const struct Segment segment);
+
+// Returns the allocated array, wherever it is stored.
+static struct Segment *allocated_of(const struct Allocator *allocator);
+
+// Returns the bitmap of the used spots of the allocated array, wherever it is
+// stored.
+static bitmap_word *used_of(const struct Allocator *allocator);
+
+// Returns the biggest capacity whose metadata fits in the given number of
+// bytes.
+static unsigned int capacity_for(size_t metadata_size);
+
+// Points the allocated array and its bitmap into a metadata buffer, after the
+// part used by the list, according to the capacity of the allocator.
+static void carve_table(struct Allocator *allocator, void *metadata);
+
+// Moves all the metadata of the allocator to its spare buffer.
+static void grow(struct Allocator *allocator);
+
+// Continues an FNV-1a hash over the given bytes.
+static uint64_t checksum_of(uint64_t hash, const void *bytes, size_t length);
+
+// Returns the checksum of a snapshot, leaving out its checksum field.
+static uint64_t snapshot_checksum(const struct AllocatorSnapshot *snapshot);
 
 /************************************ MAIN ************************************/
 
@@ -34,145 +134,937 @@ static unsigned int first_free(const struct Allocator *allocator);
 
 // Well, malloc, but for blocks...
 block_ptr block_malloc(struct Allocator *allocator, unsigned int size) {
-    // We look for a free Segment big enough to hold size.
-    struct CircularLink *link = get_head(&allocator->list);
-    // Used to remove a link if it has exactly the size we want.
-    list_index link_address = allocator->list.head;
-    for (unsigned int i = 0; i < allocator->list.length; i++) {
-        if (link->segment.length > size) {
-            // We extract an allocated segment from the big one.
-            struct Segment allocated_segment =
-                extract_from(&link->segment, size);
-            // We add the allocated Segment to the allocated array.
-            unsigned int allocated_index = first_free(allocator);
-            allocator->allocated[allocated_index] = allocated_segment;
-            allocator->used[allocated_index] = 1;
-            // We return the expected pointer.
-            return allocated_segment.start;
-        } else if (link->segment.length == size) {
-            // EGDE CASE
-            // The allocated segment is the link segment.
-            struct Segment allocated_segment = link->segment;
-            // We remove the now empty link.
-            remove_link(&allocator->list, link_address);
-            // We add the allocated Segment to the allocated array.
-            unsigned int allocated_index = first_free(allocator);
-            allocator->allocated[allocated_index] = allocated_segment;
-            allocator->used[allocated_index] = 1;
-            // We return the expected pointer.
-            return allocated_segment.start;
-        } else {
-            // We look into the next link.
-            link_address = link->next;
-            link = next_link(&allocator->list, link);
+    block_ptr allocated = malloc_unrecorded(allocator, size);
+    record_call(allocator, TRACE_MALLOC, size, allocated, 1);
+    return allocated;
+}
+
+// Like block_malloc, but the returned address is a multiple of alignment,
+// which must be a power of two. The blocks skipped to reach the aligned address
+// stay free.
+block_ptr block_malloc_aligned(struct Allocator *allocator, unsigned int size,
+                               unsigned int alignment) {
+    // Sanity check.
+    assert((alignment != 0) && ((alignment & (alignment - 1)) == 0));
+    if (size == 0) {
+        // EDGE CASE
+        // Empty segments have no size class, nothing is handed out.
+        allocator->failed_calls++;
+        record_call(allocator, TRACE_MALLOC, size, BLOCK_PTR_NONE, alignment);
+        return BLOCK_PTR_NONE;
+    }
+    if (alignment == 1) {
+        // Any address will do.
+        block_ptr allocated = malloc_unrecorded(allocator, size);
+        record_call(allocator, TRACE_MALLOC, size, allocated, 1);
+        return allocated;
+    }
+    // We look for a free Segment holding an aligned range of size blocks,
+    // giving the callback a chance to free some if there is none.
+    list_index link_index = find_aligned_link(allocator, size, alignment);
+    if (link_index == LIST_INDEX_NONE) {
+        low_memory(allocator, size);
+        link_index = find_aligned_link(allocator, size, alignment);
+    }
+    if (link_index == LIST_INDEX_NONE) {
+        allocator->failed_calls++;
+        record_call(allocator, TRACE_MALLOC, size, BLOCK_PTR_NONE, alignment);
+        return BLOCK_PTR_NONE;
+    }
+    struct Segment free_segment =
+        get_link(&allocator->list, link_index)->segment;
+    unsigned int padding = (0u - free_segment.start) & (alignment - 1);
+    // Cutting the free segment in three parts takes one more link.
+    int splits = (padding > 0) && (free_segment.length - padding > size);
+    if (!has_room(allocator, 1) || (splits && !has_free_link(allocator))) {
+        // The allocated array or the free list is full.
+        allocator->failed_calls++;
+        record_call(allocator, TRACE_MALLOC, size, BLOCK_PTR_NONE, alignment);
+        return BLOCK_PTR_NONE;
+    }
+
+    // The free segment is cut in up to three parts, the middle one being
+    // allocated.
+    struct Segment leading_segment = {.start = free_segment.start,
+                                      .length = padding};
+    struct Segment allocated_segment = {.start = free_segment.start + padding,
+                                        .length = size};
+    struct Segment trailing_segment = {.start = end_of(allocated_segment),
+                                       .length = end_of(free_segment) -
+                                                 end_of(allocated_segment)};
+    if (padding > 0) {
+        // The link keeps the leading part.
+        resize_link(&allocator->list, link_index, leading_segment);
+        if (trailing_segment.length > 0) {
+            // The trailing part cannot touch another free segment, so it just
+            // gets a link of its own.
+            release_segment(allocator, trailing_segment);
         }
+    } else if (trailing_segment.length > 0) {
+        // The link keeps the trailing part.
+        resize_link(&allocator->list, link_index, trailing_segment);
+    } else {
+        // EDGE CASE
+        // The allocated segment is the link segment.
+        remove_link(&allocator->list, link_index);
     }
-    // Should never happen in our simplified case.
-    assert(0);
+    // We add the allocated Segment to the allocated array.
+    record_segment(allocator, allocated_segment);
+    record_call(allocator, TRACE_MALLOC, size, allocated_segment.start,
+                alignment);
+    return allocated_segment.start;
 }
 
 // free, but for blocks.
 void block_free(struct Allocator *allocator, block_ptr allocated) {
-    // We first grab the index of the Segment for the allocated block.
+    record_call(allocator, TRACE_FREE, 0, allocated, 0);
+    free_unrecorded(allocator, allocated);
+}
+
+// Resizes an allocated segment and returns its address. The segment grows in
+// place into the free segment following it when possible. Otherwise it moves
+// to a new address, and the caller should copy its contents over before
+// allocating anything else.
+block_ptr block_realloc(struct Allocator *allocator, block_ptr allocated,
+                        unsigned int size) {
+    // Sanity check, use block_free to give the whole segment back.
+    assert(size > 0);
     unsigned int allocated_segment_index =
         get_segment_index(allocator, allocated);
-    // We grab the associated segment.
-    struct Segment allocated_segment =
-        allocator->allocated[allocated_segment_index];
-    // We clare the presence flag of the Segment from the allocator.
-    allocator->used[allocated_segment_index] = 0;
-    // Used to handle the case where bothe the preceding and following links can
-    // be merged.
-    int found_merge = 0;
-    struct CircularLink *merged_link;
-
-    // We check if we can insert the Segment in an existing one.
-    struct CircularLink *link = get_head(&allocator->list);
-    // In case we need it.
-    list_index merged_link_index = allocator->list.head;
-
-    for (list_index i = 0; i < CIRCULAR_LIST_MAX_LEN; i++) {
-        if ((found_merge == 0) &&
-            (are_contiguous(link->segment, allocated_segment))) {
-            // We merge the freed segment into an existing one.
-            link->segment = merge(link->segment, allocated_segment);
-            // We check for an opportunity to merge the now bigger segment with
-            // its successor or predecessor. We should only check the remaining
-            // links. We have to do this because we don't know who is pointing
-            // twords us.
-            found_merge = 1;
-            merged_link = link;
-        } else if ((found_merge == 1) &&
-                   (are_contiguous(merged_link->segment, link->segment))) {
-            // After merging our allocated segment into an existing link, the
-            // link became big enough to be merged with a third one.
-            link->segment = merge(link->segment, merged_link->segment);
-            // We remove the now unused next link.
-            remove_link(&allocator->list, merged_link_index);
-            // We cannot have a new merge opportunity, only the neighbours
-            // of the freed memory are affected.
-            return;
+    struct Segment *allocated_segment =
+        &allocated_of(allocator)[allocated_segment_index];
+    if (size <= allocated_segment->length) {
+        // The segment shrinks, its tail is free again. The segment keeps its
+        // start, and thus its spot in the allocated array.
+        struct Segment tail_segment = {
+            .start = allocated + size,
+            .length = allocated_segment->length - size};
+        if ((tail_segment.length > 0) &&
+            (find_starting_at(&allocator->list, end_of(tail_segment)) ==
+             LIST_INDEX_NONE) &&
+            !has_free_link(allocator)) {
+            // EDGE CASE
+            // The tail would need a link of its own, and the list is full.
+            allocator->failed_calls++;
+            record_call(allocator, TRACE_REALLOC, size, allocated,
+                        BLOCK_PTR_NONE);
+            return BLOCK_PTR_NONE;
+        }
+        resize_allocated(allocator, allocated_segment, size);
+        if (tail_segment.length > 0) {
+            release_segment(allocator, tail_segment);
+        }
+        record_call(allocator, TRACE_REALLOC, size, allocated, allocated);
+        return allocated;
+    }
+
+    // The segment grows, we first try to take the missing blocks from the
+    // free segment right after it.
+    unsigned int missing = size - allocated_segment->length;
+    list_index following_index =
+        find_starting_at(&allocator->list, end_of(*allocated_segment));
+    if (following_index != LIST_INDEX_NONE) {
+        struct Segment following_segment =
+            get_link(&allocator->list, following_index)->segment;
+        if (following_segment.length > missing) {
+            // The free segment gives up its first blocks.
+            extract_from(&following_segment, missing);
+            resize_link(&allocator->list, following_index, following_segment);
+            resize_allocated(allocator, allocated_segment, size);
+            record_call(allocator, TRACE_REALLOC, size, allocated, allocated);
+            return allocated;
+        } else if (following_segment.length == missing) {
+            // EDGE CASE
+            // The free segment is absorbed whole.
+            remove_link(&allocator->list, following_index);
+            resize_allocated(allocator, allocated_segment, size);
+            record_call(allocator, TRACE_REALLOC, size, allocated, allocated);
+            return allocated;
+        }
+    }
+
+    // The segment has to move. The former one is only freed once the new one
+    // is allocated, so that they do not overlap, and is kept if there is no
+    // room for the new one.
+    block_ptr moved = malloc_unrecorded(allocator, size);
+    if (moved != BLOCK_PTR_NONE) {
+        free_unrecorded(allocator, allocated);
+    }
+    record_call(allocator, TRACE_REALLOC, size, allocated, moved);
+    return moved;
+}
+
+// Allocates count segments of the given size at once, writing their addresses
+// to out. The segments are carved from a single free segment when possible.
+void block_malloc_n(struct Allocator *allocator, unsigned int size,
+                    unsigned int count, block_ptr *out) {
+    if ((count == 0) || (size == 0) ||
+        (count > largest_free(allocator) / size) ||
+        !has_room(allocator, count)) {
+        // No free segment or not enough spots can hold the whole batch, each
+        // segment is allocated on its own.
+        for (unsigned int i = 0; i < count; i++) {
+            out[i] = block_malloc(allocator, size);
+        }
+        return;
+    }
+
+    // We look for a free Segment big enough to hold the whole batch.
+    list_index link_index = find_link(allocator, size * count);
+    struct CircularLink *link = get_link(&allocator->list, link_index);
+
+    struct Segment batch_segment;
+    if (link->segment.length > size * count) {
+        // The batch is carved from the beginning of the free segment, which
+        // only has to be resized once.
+        struct Segment remaining_segment = link->segment;
+        batch_segment = extract_from(&remaining_segment, size * count);
+        resize_link(&allocator->list, link_index, remaining_segment);
+    } else {
+        // EDGE CASE
+        // The batch takes the whole free segment.
+        batch_segment = link->segment;
+        remove_link(&allocator->list, link_index);
+    }
+    // The batch is then cut into the allocated segments.
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        struct Segment allocated_segment = extract_from(&batch_segment, size);
+        record_segment(allocator, allocated_segment);
+        out[i] = allocated_segment.start;
+    }
+    // The last allocated segment is what remains of the batch.
+    record_segment(allocator, batch_segment);
+    out[count - 1] = batch_segment.start;
+    for (unsigned int i = 0; i < count; i++) {
+        record_call(allocator, TRACE_MALLOC, size, out[i], 1);
+    }
+}
+
+// Frees count allocated segments at once. The array of addresses is sorted in
+// place, so that neighbouring segments are merged before going back to the
+// list.
+void block_free_n(struct Allocator *allocator, block_ptr *allocated,
+                  unsigned int count) {
+    if (count == 0) {
+        return;
+    }
+    // Each segment of the batch is recorded as a call of its own.
+    for (unsigned int i = 0; i < count; i++) {
+        record_call(allocator, TRACE_FREE, 0, allocated[i], 0);
+    }
+    sort_blocks(allocated, count);
+    // The freed segments are gathered into runs of contiguous segments, each
+    // run going back to the list in a single step.
+    struct Segment run;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int index = get_segment_index(allocator, allocated[i]);
+        struct Segment allocated_segment = allocated_of(allocator)[index];
+        release_index(allocator, index);
+        if (i == 0) {
+            run = allocated_segment;
+        } else if (end_of(run) == allocated_segment.start) {
+            run = merge(run, allocated_segment);
         } else {
-            if (found_merge == 0) {
-                // We are looking for the first merge opportunity, we must
-                // update the merge index in case the next link is the right
-                // one.
-                merged_link_index = link->next;
-            }
-            // We haven't found a contiguous segment yet, we keep searching.
-            link = next_link(&allocator->list, link);
+            // The run is over, it is free again.
+            release_segment(allocator, run);
+            run = allocated_segment;
         }
     }
-    // If we reach this line, it means that no fusion was possible. We add a new
-    // link to the CircularList. This will fail if the memory fragments beyond
-    // CIRCULAR_LIST_MAX_LEN.
-    struct CircularLink new_link = {.next = 0, .segment = allocated_segment};
-    insert_link(&(allocator->list), new_link);
+    release_segment(allocator, run);
+}
+
+// Slides all the allocated segments down to the start of the memory, so that
+// the free blocks end up in a single segment. The runs of segments that moved
+// are written to relocations by increasing address, and their number is
+// returned. The relocations array must hold as many entries as there are free
+// segments.
+unsigned int block_compact(struct Allocator *allocator,
+                           struct Relocation *relocations) {
+    struct CircularList *list = &allocator->list;
+    if (list->length == 0) {
+        // EDGE CASE
+        // Without free blocks, the allocated segments are already packed.
+        return 0;
+    }
+    // The allocated segments between two free segments form a run which moves
+    // as a whole. The free list being sorted by address, walking it from its
+    // head gives the runs in order. Nothing before the head moves.
+    unsigned int count = 0;
+    list_index index = list->head;
+    block_ptr destination = get_link(list, index)->segment.start;
+    for (unsigned int i = 0; i < list->length; i++) {
+        struct Segment free_segment = get_link(list, index)->segment;
+        index = get_link(list, index)->next;
+        block_ptr run_end = (i + 1 < list->length)
+                                ? get_link(list, index)->segment.start
+                                : end_of(allocator->memory);
+        struct Segment run = {.start = end_of(free_segment),
+                              .length = run_end - end_of(free_segment)};
+        if (run.length == 0) {
+            // EDGE CASE
+            // The last free segment ends the memory.
+            continue;
+        }
+        relocations[count] = (struct Relocation){
+            .from = run.start, .to = destination, .length = run.length};
+        count++;
+        // A recorded trace has to move its addresses along to be replayed.
+        record_call(allocator, TRACE_COMPACT, run.length, run.start,
+                    destination);
+        // Each segment of the run is hashed again under its new start. A new
+        // start is always below the former start of the segments left to
+        // move, so they cannot collide.
+        block_ptr allocated = run.start;
+        while (allocated < end_of(run)) {
+            unsigned int allocated_index =
+                get_segment_index(allocator, allocated);
+            struct Segment moved_segment =
+                allocated_of(allocator)[allocated_index];
+            release_index(allocator, allocated_index);
+            allocated = end_of(moved_segment);
+            moved_segment.start -= run.start - destination;
+            record_segment(allocator, moved_segment);
+        }
+        destination += run.length;
+    }
+    // All the free blocks are now gathered at the end of the memory.
+    reset_list(list, (struct Segment){.start = destination,
+                                      .length = end_of(allocator->memory) -
+                                                destination});
+    return count;
+}
+
+// Returns the number of blocks of an allocated segment.
+unsigned int block_size(const struct Allocator *allocator,
+                        block_ptr allocated) {
+    return allocated_of(allocator)[get_segment_index(allocator, allocated)]
+        .length;
+}
+
+// Returns the number of live allocations.
+unsigned int live_allocations(const struct Allocator *allocator) {
+    return allocator->allocated_count;
+}
+
+// Returns the length of the biggest free segment, which is the biggest size
+// block_malloc can currently satisfy.
+unsigned int largest_free(const struct Allocator *allocator) {
+    // The root of the tree knows the longest Segment of the whole list.
+    return longest_link(&allocator->list);
+}
+
+// Returns the statistics of the allocator, in constant time.
+struct AllocatorStats allocator_stats(const struct Allocator *allocator) {
+    struct AllocatorStats stats;
+    stats.free_blocks = allocator->list.free_blocks;
+    stats.largest_free = largest_free(allocator);
+    stats.free_segments = allocator->list.length;
+    stats.live_allocations = live_allocations(allocator);
+    stats.malloc_calls = allocator->malloc_calls;
+    stats.free_calls = allocator->free_calls;
+    stats.realloc_calls = allocator->realloc_calls;
+    stats.failed_calls = allocator->failed_calls;
+    // The searches of the resizes are counted too, but they are rare enough
+    // not to skew the average.
+    stats.visited_per_malloc =
+        (allocator->malloc_calls == 0)
+            ? 0.0
+            : (double)allocator->list.visited / allocator->malloc_calls;
+    for (unsigned int i = 0; i < CIRCULAR_LIST_BIN_COUNT; i++) {
+        stats.size_histogram[i] = allocator->size_histogram[i];
+    }
+    return stats;
+}
+
+// Returns the allocated Segment at the given spot of the allocated array, or
+// NULL if the spot is free.
+const struct Segment *get_allocated(const struct Allocator *allocator,
+                                    unsigned int index) {
+    if (bitmap_get(used_of(allocator), index) == 0) {
+        return NULL;
+    }
+    return &allocated_of(allocator)[index];
 }
 
 // Defines a new allocator..
 struct Allocator new_allocator(const struct Segment memory) {
+    // Segregated fit is the fastest policy for most workloads.
+    return new_allocator_with_policy(memory, SEGREGATED_FIT);
+}
+
+// Defines a new allocator which chooses free segments with the given policy.
+struct Allocator new_allocator_with_policy(const struct Segment memory,
+                                           enum AllocationPolicy policy) {
     // We create a new CircularList from the Segment.
     struct CircularList list = new_list(memory);
+    // We then build the new allocator, which uses its own arrays.
+    struct Allocator allocator;
+    allocator.list = list;
+    allocator.memory = memory;
+    allocator.policy = policy;
+    allocator.allocated = NULL;
+    allocator.used = NULL;
+    allocator.table_len = ALLOCATOR_TABLE_LEN;
+    allocator.capacity = ALLOCATOR_TABLE_LEN / 2;
+    allocator.allocated_count = 0;
+    allocator.spare_metadata = NULL;
+    allocator.spare_size = 0;
+    allocator.recorder = NULL;
+    allocator.on_low_memory = NULL;
+    allocator.low_memory_context = NULL;
+    reset_counters(&allocator);
+    // We set the presence flags of the allocator to 0.
+    bitmap_reset(used_of(&allocator), allocator.table_len);
+    // Returning the built allocator.
+    return allocator;
+}
+
+// Defines a new allocator storing its state in the given metadata buffer, which
+// must be aligned on 8 bytes. The allocator can hold as many free segments and
+// live allocations as the buffer allows.
+struct Allocator new_allocator_in(const struct Segment memory,
+                                  enum AllocationPolicy policy, void *metadata,
+                                  size_t metadata_size) {
+    unsigned int capacity = capacity_for(metadata_size);
+    // Sanity check, the buffer should at least hold the first free segment.
+    assert(capacity > 0);
+    // The list takes the beginning of the buffer.
+    struct CircularList list = new_list_in(memory, metadata, capacity);
     // We then build the new allocator.
     struct Allocator allocator;
     allocator.list = list;
-    // We set the presence flags of the allocator to 0. Note that memset is not
-    // available.
-    for (unsigned int i = 0; i < CIRCULAR_LIST_MAX_LEN; i++) {
-        allocator.used[i] = 0;
-    }
+    allocator.memory = memory;
+    allocator.policy = policy;
+    allocator.capacity = capacity;
+    allocator.allocated_count = 0;
+    allocator.spare_metadata = NULL;
+    allocator.spare_size = 0;
+    allocator.recorder = NULL;
+    allocator.on_low_memory = NULL;
+    allocator.low_memory_context = NULL;
+    reset_counters(&allocator);
+    carve_table(&allocator, metadata);
+    // We set the presence flags of the allocator to 0.
+    bitmap_reset(used_of(&allocator), allocator.table_len);
     // Returning the built allocator.
     return allocator;
 }
 
+// Starts recording the calls of the allocator into the given recorder, or stops
+// recording them if it is NULL.
+void allocator_record(struct Allocator *allocator,
+                      struct TraceRecorder *recorder) {
+    allocator->recorder = recorder;
+}
+
+// Sets the callback called when an allocation fails, or removes it if it is
+// NULL. The callback is given the allocator, the requested size and context.
+void allocator_on_low_memory(struct Allocator *allocator,
+                             low_memory_callback callback, void *context) {
+    allocator->on_low_memory = callback;
+    allocator->low_memory_context = context;
+}
+
+// Saves the state of the allocator into a snapshot, in time proportional to its
+// metadata, which has to be saved alongside. The callback, the recorder and
+// the spare buffer are not saved.
+void allocator_save(const struct Allocator *allocator,
+                    struct AllocatorSnapshot *snapshot) {
+    // Sanity check, the counter should match the bits set in the used bitmap.
+    // Saving already takes time proportional to the metadata.
+    assert(bitmap_count(used_of(allocator), allocator->table_len) ==
+           allocator->allocated_count);
+    snapshot->magic = ALLOCATOR_SNAPSHOT_MAGIC;
+    snapshot->version = ALLOCATOR_SNAPSHOT_VERSION;
+    snapshot->state_size = sizeof(struct Allocator);
+    snapshot->uses_metadata = allocator->allocated != NULL;
+    if (snapshot->uses_metadata) {
+        // The metadata buffer starts with the bitmap of the list.
+        snapshot->metadata_size = allocator_metadata_size(allocator->capacity);
+        snapshot->metadata_checksum = checksum_of(
+            CHECKSUM_SEED, allocator->list.used, snapshot->metadata_size);
+    } else {
+        snapshot->metadata_size = 0;
+        snapshot->metadata_checksum = 0;
+    }
+    // The pointers would be meaningless for another process. They are found
+    // again from the metadata buffer when attaching.
+    memcpy(&snapshot->state, allocator, sizeof(struct Allocator));
+    snapshot->state.list.links = NULL;
+    snapshot->state.list.used = NULL;
+    snapshot->state.list.start_map = NULL;
+    snapshot->state.list.end_map = NULL;
+    snapshot->state.allocated = NULL;
+    snapshot->state.used = NULL;
+    snapshot->state.spare_metadata = NULL;
+    snapshot->state.spare_size = 0;
+    snapshot->state.recorder = NULL;
+    snapshot->state.on_low_memory = NULL;
+    snapshot->state.low_memory_context = NULL;
+    // The checksum comes last, so that a snapshot interrupted while being
+    // saved is rejected.
+    snapshot->checksum = snapshot_checksum(snapshot);
+}
+
+// Sets up an allocator from a snapshot and the metadata buffer it was saved
+// with, wherever they are mapped now, in constant time. Returns 0 if the
+// snapshot is damaged, comes from an incompatible build, or the buffer is too
+// small. The metadata itself is not checked, see allocator_check_metadata.
+int allocator_attach(struct Allocator *allocator,
+                     const struct AllocatorSnapshot *snapshot, void *metadata,
+                     size_t metadata_size) {
+    if ((snapshot->magic != ALLOCATOR_SNAPSHOT_MAGIC) ||
+        (snapshot->version != ALLOCATOR_SNAPSHOT_VERSION) ||
+        (snapshot->state_size != sizeof(struct Allocator)) ||
+        (snapshot->checksum != snapshot_checksum(snapshot))) {
+        return 0;
+    }
+    if (snapshot->uses_metadata &&
+        ((metadata == NULL) || (metadata_size < snapshot->metadata_size) ||
+         (((uintptr_t)metadata % sizeof(bitmap_word)) != 0))) {
+        return 0;
+    }
+    memcpy(allocator, &snapshot->state, sizeof(struct Allocator));
+    if (snapshot->uses_metadata) {
+        // The arrays are where the metadata buffer is mapped now.
+        attach_list(&allocator->list, metadata);
+        carve_table(allocator, metadata);
+    }
+    return 1;
+}
+
+// Returns whether the metadata buffer still holds what it held when the
+// snapshot was saved, in time proportional to its size.
+int allocator_check_metadata(const struct AllocatorSnapshot *snapshot,
+                             const void *metadata) {
+    if (!snapshot->uses_metadata) {
+        // EDGE CASE
+        // The whole state is in the snapshot, which has its own checksum.
+        return 1;
+    }
+    return checksum_of(CHECKSUM_SEED, metadata, snapshot->metadata_size) ==
+           snapshot->metadata_checksum;
+}
+
+// Returns the number of bytes of metadata an allocator needs to hold up to
+// capacity free segments and capacity live allocations.
+size_t allocator_metadata_size(unsigned int capacity) {
+    // The part used by the list is rounded up so that the bitmap of the
+    // allocated array stays aligned.
+    size_t list_size = list_metadata_size(capacity);
+    list_size = BITMAP_WORDS(list_size * 8) * sizeof(bitmap_word);
+    unsigned int table_len = hash_len_for(capacity);
+    return list_size + BITMAP_WORDS(table_len) * sizeof(bitmap_word) +
+           table_len * sizeof(struct Segment);
+}
+
+// Gives the allocator a bigger metadata buffer, aligned on 8 bytes, to move to
+// once it runs out of capacity. The current buffer can be reused after the
+// move, which is the case when the spare buffer is NULL again.
+void allocator_reserve(struct Allocator *allocator, void *metadata,
+                       size_t metadata_size) {
+    allocator->spare_metadata = metadata;
+    allocator->spare_size = metadata_size;
+}
+
 // Internal functions
 
+// block_malloc, without recording the call.
+static block_ptr malloc_unrecorded(struct Allocator *allocator,
+                                   unsigned int size) {
+    if (size == 0) {
+        // EDGE CASE
+        // Empty segments have no size class, nothing is handed out.
+        allocator->failed_calls++;
+        return BLOCK_PTR_NONE;
+    }
+    // Requests bigger than the biggest free segment are rejected without
+    // searching the list, once the callback has had a chance to free some.
+    if (size > largest_free(allocator)) {
+        low_memory(allocator, size);
+        if (size > largest_free(allocator)) {
+            allocator->failed_calls++;
+            return BLOCK_PTR_NONE;
+        }
+    }
+    if (!has_room(allocator, 1)) {
+        // The allocated array is full.
+        allocator->failed_calls++;
+        return BLOCK_PTR_NONE;
+    }
+    // We look for a free Segment big enough to hold size, which exists.
+    list_index link_index = find_link(allocator, size);
+    struct CircularLink *link = get_link(&allocator->list, link_index);
+
+    struct Segment allocated_segment;
+    if (link->segment.length > size) {
+        // We extract an allocated segment from the big one. The remainder may
+        // belong to a smaller size class.
+        struct Segment remaining_segment = link->segment;
+        allocated_segment = extract_from(&remaining_segment, size);
+        resize_link(&allocator->list, link_index, remaining_segment);
+    } else {
+        // EGDE CASE
+        // The allocated segment is the link segment.
+        allocated_segment = link->segment;
+        // We remove the now empty link.
+        remove_link(&allocator->list, link_index);
+    }
+    // We add the allocated Segment to the allocated array.
+    record_segment(allocator, allocated_segment);
+    // We return the expected pointer.
+    return allocated_segment.start;
+}
+
+// block_free, without recording the call.
+static void free_unrecorded(struct Allocator *allocator, block_ptr allocated) {
+    // We first grab the index of the Segment for the allocated block.
+    unsigned int allocated_segment_index =
+        get_segment_index(allocator, allocated);
+    // We grab the associated segment.
+    struct Segment allocated_segment =
+        allocated_of(allocator)[allocated_segment_index];
+    // We clear the Segment from the allocator.
+    release_index(allocator, allocated_segment_index);
+    // The Segment is free again.
+    release_segment(allocator, allocated_segment);
+}
+
+// Counts a call of the allocator, and records it if it is being recorded.
+static void record_call(struct Allocator *allocator, enum TraceOp op,
+                        unsigned int size, block_ptr address,
+                        unsigned int argument) {
+    switch (op) {
+    case TRACE_MALLOC:
+        allocator->malloc_calls++;
+        break;
+    case TRACE_FREE:
+        allocator->free_calls++;
+        break;
+    case TRACE_COMPACT:
+        // The moves of a compaction are not calls of their own.
+        break;
+    default:
+        allocator->realloc_calls++;
+        break;
+    }
+    // Failed calls change nothing, so there is nothing to replay.
+    if ((allocator->recorder != NULL) && (address != BLOCK_PTR_NONE) &&
+        (argument != BLOCK_PTR_NONE)) {
+        trace_record(allocator->recorder, op, size, address, argument);
+    }
+}
+
+// Returns the index of the free link an allocation of the given size should be
+// carved from according to the policy of the allocator.
+static list_index find_link(struct Allocator *allocator, unsigned int size) {
+    switch (allocator->policy) {
+    case FIRST_FIT:
+        return find_first_fit(&allocator->list, size);
+    case NEXT_FIT:
+        return find_next_fit(&allocator->list, size);
+    case BEST_FIT:
+        return find_best_fit(&allocator->list, size);
+    case WORST_FIT:
+        return find_worst_fit(&allocator->list, size);
+    default:
+        return find_fit(&allocator->list, size);
+    }
+}
+
+// Returns the index of a free link holding an aligned range of size blocks, or
+// LIST_INDEX_NONE without searching when size is bigger than any free segment.
+static list_index find_aligned_link(struct Allocator *allocator,
+                                    unsigned int size, unsigned int alignment) {
+    if (size > largest_free(allocator)) {
+        return LIST_INDEX_NONE;
+    }
+    return find_aligned_fit(&allocator->list, size, alignment);
+}
+
+// Calls the low memory callback of the allocator, if any.
+static void low_memory(struct Allocator *allocator, unsigned int size) {
+    if (allocator->on_low_memory != NULL) {
+        allocator->on_low_memory(allocator, size, allocator->low_memory_context);
+    }
+}
+
 // Returns the index of the memory Segment with information on the allocated
 // memory block.
 static unsigned int get_segment_index(const struct Allocator *allocator,
                                       block_ptr allocated) {
-    // Linearly searching the Allocator.
-    for (unsigned int i = 0; i < CIRCULAR_LIST_MAX_LEN; i++) {
-        if ((allocator->used[i] == 1) &&
-            (allocator->allocated[i].start == allocated)) {
+    // Segments are stored in the first free spot after their home, so we only
+    // have to search from the home spot up to the next free one.
+    const struct Segment *allocated_array = allocated_of(allocator);
+    const bitmap_word *used = used_of(allocator);
+    unsigned int index = home_of(allocator, allocated);
+    for (unsigned int i = 0; i < allocator->table_len; i++) {
+        if (bitmap_get(used, index) == 0) {
+            // We have reached a free spot, the segment is not in the table.
+            break;
+        } else if (allocated_array[index].start == allocated) {
             // We have found the right Segment, we may return its index.
-            return i;
+            return index;
         }
+        index = (index + 1) & (allocator->table_len - 1);
     }
     // Should never happen.
     assert(0);
 }
 
-static unsigned int first_free(const struct Allocator *allocator) {
-    for (unsigned int i = 0; i < CIRCULAR_LIST_MAX_LEN; i++) {
-        if (allocator->used[i] == 0) {
-            // We have found a free spot.
-            return i;
+// Returns the index of the first free spot to put an allocated segment
+// starting at the given address within the allocator.
+static unsigned int first_free(const struct Allocator *allocator,
+                               block_ptr allocated) {
+    // The bitmap lets us skip a whole word of used spots at once.
+    unsigned int index =
+        bitmap_find_clear(used_of(allocator), allocator->table_len,
+                          home_of(allocator, allocated));
+    // Should never happen, the callers make room first.
+    assert(index < allocator->table_len);
+    return index;
+}
+
+// Returns the spot of the allocated array where the search for a segment
+// starting at the given address begins.
+static unsigned int home_of(const struct Allocator *allocator,
+                            block_ptr allocated) {
+    return hash_of(allocated, allocator->table_len);
+}
+
+// Removes the allocated segment at the given index from the allocated array,
+// keeping the following segments reachable from their home spot.
+static void release_index(struct Allocator *allocator, unsigned int index) {
+    struct Segment *allocated_array = allocated_of(allocator);
+    bitmap_word *used = used_of(allocator);
+    const unsigned int mask = allocator->table_len - 1;
+    // The spot is now a hole in the table.
+    bitmap_clear(used, index);
+    allocator->allocated_count--;
+    allocator->size_histogram[size_class(allocated_array[index].length)]--;
+    unsigned int hole = index;
+    // The segments placed after the hole may have been pushed past it by a
+    // collision. We move them back into the hole when it lies between their
+    // home and their current spot.
+    for (unsigned int next = (index + 1) & mask; bitmap_get(used, next) == 1;
+         next = (next + 1) & mask) {
+        unsigned int home = home_of(allocator, allocated_array[next].start);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            allocated_array[hole] = allocated_array[next];
+            bitmap_set(used, hole);
+            bitmap_clear(used, next);
+            hole = next;
         }
     }
-    // Should never happen in our simplified case.
-    assert(0);
+}
+
+// Changes the length of an allocated Segment in place.
+static void resize_allocated(struct Allocator *allocator,
+                             struct Segment *allocated_segment,
+                             unsigned int length) {
+    allocator->size_histogram[size_class(allocated_segment->length)]--;
+    allocator->size_histogram[size_class(length)]++;
+    allocated_segment->length = length;
+}
+
+// Sets the statistics counters of a new allocator to 0.
+static void reset_counters(struct Allocator *allocator) {
+    allocator->malloc_calls = 0;
+    allocator->free_calls = 0;
+    allocator->realloc_calls = 0;
+    allocator->failed_calls = 0;
+    for (unsigned int i = 0; i < CIRCULAR_LIST_BIN_COUNT; i++) {
+        allocator->size_histogram[i] = 0;
+    }
+}
+
+// Returns whether count more allocated segments fit in the allocator, moving
+// to the spare metadata buffer if needed.
+static int has_room(struct Allocator *allocator, unsigned int count) {
+    // Free segments are always separated by allocated ones, so the list never
+    // holds more than one link per allocated segment plus one. Keeping the
+    // allocations within the capacity of the list thus lets any free succeed.
+    unsigned int capacity = allocator->capacity;
+    if (allocator->list.capacity < capacity) {
+        capacity = allocator->list.capacity;
+    }
+    if (count <= capacity - allocator->allocated_count) {
+        return 1;
+    } else if (allocator->spare_metadata != NULL) {
+        // The allocated array is getting crowded, time to move.
+        grow(allocator);
+        return has_room(allocator, count);
+    }
+    return 0;
+}
+
+// Returns whether one more link fits in the free list, moving to the spare
+// metadata buffer if needed.
+static int has_free_link(struct Allocator *allocator) {
+    if (allocator->list.length < allocator->list.capacity) {
+        return 1;
+    } else if (allocator->spare_metadata != NULL) {
+        grow(allocator);
+        return 1;
+    }
+    return 0;
+}
+
+// Adds an allocated Segment to the allocated array.
+static void record_segment(struct Allocator *allocator,
+                           const struct Segment segment) {
+    // Sanity check, the callers make room first.
+    assert(allocator->allocated_count < allocator->table_len);
+    unsigned int index = first_free(allocator, segment.start);
+    allocated_of(allocator)[index] = segment;
+    bitmap_set(used_of(allocator), index);
+    allocator->allocated_count++;
+    allocator->size_histogram[size_class(segment.length)]++;
+}
+
+// Gives a Segment back to the free segments, merging it with its neighbours.
+static void release_segment(struct Allocator *allocator,
+                            const struct Segment segment) {
+    struct CircularList *list = &allocator->list;
+    // We look for the free segments ending right before and starting right
+    // after the freed one, which are the only ones it can be merged with.
+    list_index previous_index = find_ending_at(list, segment.start);
+    list_index following_index = find_starting_at(list, end_of(segment));
+
+    if ((previous_index != LIST_INDEX_NONE) &&
+        (following_index != LIST_INDEX_NONE)) {
+        // The freed segment fills the gap between two free segments, all three
+        // become a single one.
+        struct Segment merged_segment =
+            merge(merge(get_link(list, previous_index)->segment, segment),
+                  get_link(list, following_index)->segment);
+        // Because the following link comes right after the previous one, it
+        // takes the spot of the previous link when the latter is removed.
+        remove_link(list, previous_index);
+        resize_link(list, previous_index, merged_segment);
+    } else if (previous_index != LIST_INDEX_NONE) {
+        // We merge the freed segment into the preceding one.
+        resize_link(list, previous_index,
+                    merge(get_link(list, previous_index)->segment, segment));
+    } else if (following_index != LIST_INDEX_NONE) {
+        // We merge the freed segment into the following one.
+        resize_link(list, following_index,
+                    merge(get_link(list, following_index)->segment, segment));
+    } else {
+        // No fusion was possible. We add a new link to the CircularList, after
+        // moving to the spare metadata buffer if the list is full. Without a
+        // spare buffer, the callers have made sure the link fits.
+        if ((list->length == list->capacity) &&
+            (allocator->spare_metadata != NULL)) {
+            grow(allocator);
+        }
+        struct CircularLink new_link = {.next = 0, .segment = segment};
+        insert_link(list, new_link);
+    }
+}
+
+// Returns the allocated array, wherever it is stored.
+static struct Segment *allocated_of(const struct Allocator *allocator) {
+    if (allocator->allocated == NULL) {
+        return (struct Segment *)allocator->inline_allocated;
+    }
+    return allocator->allocated;
+}
+
+// Returns the bitmap of the used spots of the allocated array, wherever it is
+// stored.
+static bitmap_word *used_of(const struct Allocator *allocator) {
+    if (allocator->used == NULL) {
+        return (bitmap_word *)allocator->inline_used;
+    }
+    return allocator->used;
+}
+
+// Returns the biggest capacity whose metadata fits in the given number of
+// bytes.
+static unsigned int capacity_for(size_t metadata_size) {
+    // The size of the metadata grows with the capacity, so we can search for
+    // the capacity by dichotomy.
+    // Each link takes more than one byte, and the hash tables cannot have more
+    // than 2^31 spots.
+    unsigned int lowest = 0;
+    unsigned int highest = 1u << 30;
+    if (metadata_size / sizeof(struct CircularLink) < highest) {
+        highest = metadata_size / sizeof(struct CircularLink);
+    }
+    while (lowest < highest) {
+        unsigned int middle = lowest + (highest - lowest + 1) / 2;
+        if (allocator_metadata_size(middle) <= metadata_size) {
+            lowest = middle;
+        } else {
+            highest = middle - 1;
+        }
+    }
+    return lowest;
+}
+
+// Points the allocated array and its bitmap into a metadata buffer, after the
+// part used by the list, according to the capacity of the allocator.
+static void carve_table(struct Allocator *allocator, void *metadata) {
+    // Sanity check, the bitmap words need to be aligned.
+    assert(((uintptr_t)metadata % sizeof(bitmap_word)) == 0);
+    size_t list_size = list_metadata_size(allocator->capacity);
+    list_size = BITMAP_WORDS(list_size * 8) * sizeof(bitmap_word);
+    char *cursor = (char *)metadata + list_size;
+    allocator->table_len = hash_len_for(allocator->capacity);
+    allocator->used = (bitmap_word *)cursor;
+    cursor += BITMAP_WORDS(allocator->table_len) * sizeof(bitmap_word);
+    allocator->allocated = (struct Segment *)cursor;
+}
+
+// Moves all the metadata of the allocator to its spare buffer.
+static void grow(struct Allocator *allocator) {
+    void *metadata = allocator->spare_metadata;
+    unsigned int capacity = capacity_for(allocator->spare_size);
+    // The spare buffer is used up.
+    allocator->spare_metadata = NULL;
+    allocator->spare_size = 0;
+    // Sanity check, the spare buffer should be bigger than the current one.
+    assert(capacity > allocator->list.capacity);
+    assert(capacity > allocator->allocated_count);
+
+    // The list moves first, its links keep their index.
+    move_list_to(&allocator->list, metadata, capacity);
+
+    // The allocated segments have to be hashed again since the length of the
+    // table changes.
+    const struct Segment *former_allocated = allocated_of(allocator);
+    const bitmap_word *former_used = used_of(allocator);
+    unsigned int former_len = allocator->table_len;
+    allocator->capacity = capacity;
+    carve_table(allocator, metadata);
+    bitmap_reset(used_of(allocator), allocator->table_len);
+    for (unsigned int i = 0; i < former_len; i++) {
+        if (bitmap_get(former_used, i)) {
+            unsigned int index = first_free(allocator, former_allocated[i].start);
+            allocated_of(allocator)[index] = former_allocated[i];
+            bitmap_set(used_of(allocator), index);
+        }
+    }
+}
+
+// Continues an FNV-1a hash over the given bytes.
+static uint64_t checksum_of(uint64_t hash, const void *bytes, size_t length) {
+    const unsigned char *cursor = bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ cursor[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Returns the checksum of a snapshot, leaving out its checksum field.
+static uint64_t snapshot_checksum(const struct AllocatorSnapshot *snapshot) {
+    const char *bytes = (const char *)snapshot;
+    size_t before = offsetof(struct AllocatorSnapshot, checksum);
+    size_t after = before + sizeof(snapshot->checksum);
+    uint64_t hash = checksum_of(CHECKSUM_SEED, bytes, before);
+    return checksum_of(hash, bytes + after,
+                       sizeof(struct AllocatorSnapshot) - after);
 }
 
 /************************************ EOF *************************************/
@@ -0,0 +1,99 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "bitmap.h"
+
+// Used to clear a whole bitmap at once.
+#include <string.h>
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the mask of the bits of the word at the given index which belong to
+// a bitmap holding length bits.
+static bitmap_word valid_bits(unsigned int length, unsigned int word_index);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Returns the value of the bit at the given index.
+int bitmap_get(const bitmap_word *bitmap, unsigned int index) {
+    return (bitmap[index / BITMAP_WORD_BITS] >> (index % BITMAP_WORD_BITS)) & 1;
+}
+
+// Sets the bit at the given index.
+void bitmap_set(bitmap_word *bitmap, unsigned int index) {
+    bitmap[index / BITMAP_WORD_BITS] |= (bitmap_word)1
+                                        << (index % BITMAP_WORD_BITS);
+}
+
+// Clears the bit at the given index.
+void bitmap_clear(bitmap_word *bitmap, unsigned int index) {
+    bitmap[index / BITMAP_WORD_BITS] &=
+        ~((bitmap_word)1 << (index % BITMAP_WORD_BITS));
+}
+
+// Clears all the bits of a bitmap holding length bits.
+void bitmap_reset(bitmap_word *bitmap, unsigned int length) {
+    memset(bitmap, 0, BITMAP_WORDS(length) * sizeof(bitmap_word));
+}
+
+// Returns the index of the first clear bit at or after from, wrapping around at
+// the end of the bitmap. Returns length if all the bits are set.
+unsigned int bitmap_find_clear(const bitmap_word *bitmap, unsigned int length,
+                               unsigned int from) {
+    const unsigned int words = BITMAP_WORDS(length);
+    unsigned int word_index = from / BITMAP_WORD_BITS;
+    // The bits before from in the first word are only checked after wrapping
+    // around, hence words + 1 iterations.
+    bitmap_word clear_bits = ~bitmap[word_index] &
+                             (~(bitmap_word)0 << (from % BITMAP_WORD_BITS));
+    for (unsigned int i = 0; i <= words; i++) {
+        clear_bits &= valid_bits(length, word_index);
+        if (clear_bits != 0) {
+            // The lowest clear bit is the one we are looking for.
+            return word_index * BITMAP_WORD_BITS + __builtin_ctzll(clear_bits);
+        }
+        // Checking the next word.
+        word_index = (word_index + 1 == words) ? 0 : word_index + 1;
+        clear_bits = ~bitmap[word_index];
+    }
+    // All the bits are set.
+    return length;
+}
+
+// Returns the number of bits set in a bitmap holding length bits.
+unsigned int bitmap_count(const bitmap_word *bitmap, unsigned int length) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < BITMAP_WORDS(length); i++) {
+        count += __builtin_popcountll(bitmap[i] & valid_bits(length, i));
+    }
+    return count;
+}
+
+// Internal functions.
+
+// Returns the mask of the bits of the word at the given index which belong to
+// a bitmap holding length bits.
+static bitmap_word valid_bits(unsigned int length, unsigned int word_index) {
+    if ((word_index + 1) * BITMAP_WORD_BITS <= length) {
+        // The word is fully within the bitmap.
+        return ~(bitmap_word)0;
+    } else {
+        // Only the low bits of the last word are part of the bitmap.
+        return ((bitmap_word)1 << (length % BITMAP_WORD_BITS)) - 1;
+    }
+}
+
+/************************************ EOF *************************************/
@@ -21,6 +21,11 @@
 static int are_contiguous_ordered(const struct Segment segmentA,
                                   const struct Segment segmentB);
 
+// Moves the address at the given spot down the heap formed by the first count
+// addresses, until it is bigger than both its children.
+static void sift_down(block_ptr *addresses, unsigned int spot,
+                      unsigned int count);
+
 /************************************ MAIN ************************************/
 
 /* The main function of your code goes here. */
@@ -62,6 +67,29 @@ struct Segment merge(const struct Segment segmentA,
     }
 }
 
+// Returns the home spot of an address in a hash table with the given number of
+// spots, which must be a power of two.
+unsigned int hash_of(block_ptr address, unsigned int table_len) {
+    // Fibonacci hashing, the high bits of the product are the best mixed ones.
+    unsigned int hash = address * 2654435769u;
+    unsigned int table_bits = __builtin_ctz(table_len);
+    // Shifting by the whole width would be undefined.
+    if (table_bits == 0) {
+        return 0;
+    }
+    return hash >> (sizeof(unsigned int) * 8 - table_bits);
+}
+
+// Returns the number of spots a hash table needs to hold count addresses with
+// short lookups, which is the smallest power of two at least twice count.
+unsigned int hash_len_for(unsigned int count) {
+    unsigned int length = 1;
+    while (length < 2 * count) {
+        length *= 2;
+    }
+    return length;
+}
+
 // Returns a subsegment of given size from within the provided one. Also resizes
 // the original segment.
 struct Segment extract_from(struct Segment *segment_ptr, unsigned int size) {
@@ -79,6 +107,23 @@ struct Segment extract_from(struct Segment *segment_ptr, unsigned int size) {
     return (struct Segment){.start = new_segment_start, .length = size};
 }
 
+// Sorts an array of addresses in increasing order, in place.
+void sort_blocks(block_ptr *addresses, unsigned int count) {
+    // Heapsort needs neither recursion nor a second buffer. We first build a
+    // heap with the biggest address on top.
+    for (unsigned int spot = count / 2; spot > 0; spot--) {
+        sift_down(addresses, spot - 1, count);
+    }
+    // The top of the heap is then moved to the end of the array, one address
+    // at a time.
+    for (unsigned int end = count; end > 1; end--) {
+        block_ptr biggest = addresses[0];
+        addresses[0] = addresses[end - 1];
+        addresses[end - 1] = biggest;
+        sift_down(addresses, 0, end - 1);
+    }
+}
+
 // Internal functions.
 
 // Same as are_contiguous, but ordered. Will only work if segmentA comes first.
@@ -87,4 +132,24 @@ static int are_contiguous_ordered(const struct Segment segmentA,
     return segmentB.start == end_of(segmentA);
 }
 
+// Moves the address at the given spot down the heap formed by the first count
+// addresses, until it is bigger than both its children.
+static void sift_down(block_ptr *addresses, unsigned int spot,
+                      unsigned int count) {
+    block_ptr moved = addresses[spot];
+    while (2 * spot + 1 < count) {
+        // We compare the address with the biggest of its children.
+        unsigned int child = 2 * spot + 1;
+        if ((child + 1 < count) && (addresses[child + 1] > addresses[child])) {
+            child++;
+        }
+        if (addresses[child] <= moved) {
+            break;
+        }
+        addresses[spot] = addresses[child];
+        spot = child;
+    }
+    addresses[spot] = moved;
+}
+
 /************************************ EOF *************************************/
@@ -0,0 +1,212 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "buddy_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+// Used to check the alignment of metadata buffers.
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The orders have to fit in the free mask and in an unsigned char.
+_Static_assert(BUDDY_MAX_ORDER < 32, "BUDDY_MAX_ORDER must be less than 32");
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the order of the smallest segment holding size blocks.
+static unsigned int order_for(unsigned int size);
+
+// Adds the segment of the given order at the given offset to the free lists.
+static void push_free(struct BuddyAllocator *buddy, unsigned int offset,
+                      unsigned int order);
+
+// Removes the segment at the given offset from the free lists.
+static void pop_free(struct BuddyAllocator *buddy, unsigned int offset);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Like block_malloc, the size is rounded up to the next power of two. Returns
+// BLOCK_PTR_NONE when no free segment is big enough.
+block_ptr buddy_malloc(struct BuddyAllocator *buddy, unsigned int size) {
+    unsigned int order = order_for(size);
+    if (order > BUDDY_MAX_ORDER) {
+        // Segments that big never exist.
+        return BLOCK_PTR_NONE;
+    }
+    // We look for the smallest free segment of a big enough order.
+    unsigned int big_enough = buddy->free_mask >> order;
+    if (big_enough == 0) {
+        // No free segment is big enough.
+        return BLOCK_PTR_NONE;
+    }
+    unsigned int found_order = order + __builtin_ctz(big_enough);
+    unsigned int offset = buddy->heads[found_order];
+    pop_free(buddy, offset);
+
+    // The segment is split in halves until it has the right order, the upper
+    // halves staying free.
+    while (found_order > order) {
+        found_order--;
+        push_free(buddy, offset + (1u << found_order), found_order);
+    }
+    buddy->orders[offset] = order;
+    bitmap_set(buddy->used, offset);
+    return buddy->memory.start + offset;
+}
+
+// Like block_free, merging the segment with its buddies.
+void buddy_free(struct BuddyAllocator *buddy, block_ptr allocated) {
+    unsigned int offset = allocated - buddy->memory.start;
+    // Sanity check, the segment should have been allocated.
+    assert(offset < buddy->memory.length);
+    assert(bitmap_get(buddy->used, offset) == 1);
+    bitmap_clear(buddy->used, offset);
+    unsigned int order = buddy->orders[offset];
+
+    // The buddy of a segment differs from it by the bit of its order. As long
+    // as the buddy is free and whole, both merge into a segment of the next
+    // order.
+    while (order < BUDDY_MAX_ORDER) {
+        unsigned int buddy_offset = offset ^ (1u << order);
+        if ((buddy_offset + (unsigned long long)(1u << order) >
+             buddy->memory.length) ||
+            (bitmap_get(buddy->free, buddy_offset) == 0) ||
+            (buddy->orders[buddy_offset] != order)) {
+            break;
+        }
+        pop_free(buddy, buddy_offset);
+        // The merged segment starts at the lowest of the two buddies.
+        offset &= ~(1u << order);
+        order++;
+    }
+    push_free(buddy, offset, order);
+}
+
+// Returns the number of blocks of an allocated segment, which is a power of
+// two.
+unsigned int buddy_size(const struct BuddyAllocator *buddy,
+                        block_ptr allocated) {
+    unsigned int offset = allocated - buddy->memory.start;
+    // Sanity check, the segment should have been allocated.
+    assert(bitmap_get(buddy->used, offset) == 1);
+    return 1u << buddy->orders[offset];
+}
+
+// Returns the number of bytes of metadata a BuddyAllocator needs to manage a
+// memory of the given number of blocks.
+size_t buddy_metadata_size(unsigned int length) {
+    // The bitmaps come first since they have the strictest alignment, and the
+    // orders last since they have the loosest.
+    return 2 * BITMAP_WORDS((size_t)length) * sizeof(bitmap_word) +
+           2 * (size_t)length * sizeof(unsigned int) +
+           (size_t)length * sizeof(unsigned char);
+}
+
+// Defines a new BuddyAllocator storing its arrays in the given metadata buffer,
+// which must be aligned on 8 bytes and hold buddy_metadata_size(memory.length)
+// bytes. The length of the memory does not have to be a power of two.
+struct BuddyAllocator new_buddy_allocator(const struct Segment memory,
+                                          void *metadata,
+                                          size_t metadata_size) {
+    // Sanity checks.
+    assert(memory.length > 0);
+    assert(metadata_size >= buddy_metadata_size(memory.length));
+    assert(((uintptr_t)metadata % sizeof(bitmap_word)) == 0);
+    struct BuddyAllocator buddy;
+    buddy.memory = memory;
+    buddy.free_mask = 0;
+    for (unsigned int i = 0; i <= BUDDY_MAX_ORDER; i++) {
+        buddy.heads[i] = BUDDY_NONE;
+    }
+
+    // We carve the arrays from the metadata buffer.
+    char *cursor = metadata;
+    buddy.free = (bitmap_word *)cursor;
+    cursor += BITMAP_WORDS(memory.length) * sizeof(bitmap_word);
+    buddy.used = (bitmap_word *)cursor;
+    cursor += BITMAP_WORDS(memory.length) * sizeof(bitmap_word);
+    buddy.next = (unsigned int *)cursor;
+    cursor += memory.length * sizeof(unsigned int);
+    buddy.previous = (unsigned int *)cursor;
+    cursor += memory.length * sizeof(unsigned int);
+    buddy.orders = (unsigned char *)cursor;
+    bitmap_reset(buddy.free, memory.length);
+    bitmap_reset(buddy.used, memory.length);
+
+    // The memory is cut into the biggest segments whose offset is a multiple
+    // of their length. Those at the end never find their buddy.
+    unsigned int offset = 0;
+    while (offset < memory.length) {
+        unsigned int order = BUDDY_MAX_ORDER;
+        while (((offset & ((1u << order) - 1)) != 0) ||
+               (offset + (unsigned long long)(1u << order) > memory.length)) {
+            order--;
+        }
+        push_free(&buddy, offset, order);
+        offset += 1u << order;
+    }
+    return buddy;
+}
+
+// Internal functions.
+
+// Returns the order of the smallest segment holding size blocks.
+static unsigned int order_for(unsigned int size) {
+    if (size <= 1) {
+        return 0;
+    }
+    // The order of size - 1 is the number of bits needed to write it.
+    return sizeof(unsigned int) * 8 - __builtin_clz(size - 1);
+}
+
+// Adds the segment of the given order at the given offset to the free lists.
+static void push_free(struct BuddyAllocator *buddy, unsigned int offset,
+                      unsigned int order) {
+    unsigned int head = buddy->heads[order];
+    buddy->next[offset] = head;
+    buddy->previous[offset] = BUDDY_NONE;
+    if (head != BUDDY_NONE) {
+        buddy->previous[head] = offset;
+    }
+    buddy->heads[order] = offset;
+    buddy->free_mask |= 1u << order;
+    buddy->orders[offset] = order;
+    bitmap_set(buddy->free, offset);
+}
+
+// Removes the segment at the given offset from the free lists.
+static void pop_free(struct BuddyAllocator *buddy, unsigned int offset) {
+    unsigned int order = buddy->orders[offset];
+    unsigned int next = buddy->next[offset];
+    unsigned int previous = buddy->previous[offset];
+    if (previous != BUDDY_NONE) {
+        buddy->next[previous] = next;
+    } else {
+        buddy->heads[order] = next;
+    }
+    if (next != BUDDY_NONE) {
+        buddy->previous[next] = previous;
+    }
+    if (buddy->heads[order] == BUDDY_NONE) {
+        buddy->free_mask &= ~(1u << order);
+    }
+    bitmap_clear(buddy->free, offset);
+}
+
+/************************************ EOF *************************************/
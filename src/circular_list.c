@@ -18,11 +18,99 @@
 // Used for debugging, would be removed in production.
 #include <assert.h>
 
+// Used to check the alignment of metadata buffers.
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The lookups rely on the length of the maps being a power of two.
+_Static_assert((CIRCULAR_LIST_MAP_LEN & (CIRCULAR_LIST_MAP_LEN - 1)) == 0,
+               "CIRCULAR_LIST_MAP_LEN must be a power of two");
+
+/********************************** STRUCTS ***********************************/
+
+// The two maps of the list, finding links by their start or by their end.
+enum MapKey { BY_START, BY_END };
+
 /********************************* PROTOYPES **********************************/
 
 // Returns the first free spot to add a new link in the CircularList.
 static list_index first_free(const struct CircularList *list);
 
+// Adds the link at the given index to the front of its size class.
+static void bin_insert(struct CircularList *list, list_index index);
+
+// Removes the link at the given index from its size class.
+static void bin_remove(struct CircularList *list, list_index index);
+
+// Moves a link to another spot of the links array, updating everything that
+// referenced its former spot except the "next" pointer of its predecessor.
+static void move_link(struct CircularList *list, list_index from,
+                      list_index to);
+
+// Returns the longest Segment in the subtree of the given link, 0 for an empty
+// subtree.
+static unsigned int subtree_max(const struct CircularList *list,
+                                list_index index);
+
+// Adds the link at the given index to the address tree.
+static void tree_insert(struct CircularList *list, list_index index);
+
+// Removes the link at the given index from the address tree.
+static void tree_remove(struct CircularList *list, list_index index);
+
+// Updates the longest Segment of the subtrees holding the link at the given
+// index, after its Segment has changed.
+static void tree_update(struct CircularList *list, list_index index);
+
+// Moves the link at the given index one level up in the tree, in place of its
+// parent.
+static void tree_rotate_up(struct CircularList *list, list_index index);
+
+// Returns the leftmost link of the subtree at index which holds at least size
+// blocks and starts at or after the from address, or LIST_INDEX_NONE.
+static list_index tree_first_fit(struct CircularList *list, list_index index,
+                                 block_ptr from, unsigned int size);
+
+// Returns the index of the link with the highest address.
+static list_index tree_last(const struct CircularList *list);
+
+// Returns the address a link is keyed by in a map, its start for the
+// start_map and its end for the end_map.
+static block_ptr key_of(const struct CircularList *list, enum MapKey key,
+                        list_index index);
+
+// Returns the spot of the map holding the link keyed by the given address, or
+// the free spot where it would go.
+static unsigned int map_spot(const struct CircularList *list, enum MapKey key,
+                             block_ptr address);
+
+// Adds the link at the given index to a map.
+static void map_insert(struct CircularList *list, enum MapKey key,
+                       list_index index);
+
+// Removes the link at the given index from a map, keeping the following links
+// reachable from their home spot.
+static void map_remove(struct CircularList *list, enum MapKey key,
+                       list_index index);
+
+// Returns the links of the list, wherever they are stored.
+static struct CircularLink *links_of(const struct CircularList *list);
+
+// Returns the bitmap of the used links, wherever it is stored.
+static bitmap_word *used_of(const struct CircularList *list);
+
+// Returns one of the maps of the list, wherever it is stored.
+static list_index *map_of(const struct CircularList *list, enum MapKey key);
+
+// Points the arrays of the list into a metadata buffer, according to its
+// capacity and the length of its maps.
+static void carve_metadata(struct CircularList *list, void *metadata);
+
+// Sets up an empty list of known capacity and storage with a single link
+// holding the given Segment.
+static void init_list(struct CircularList *list, const struct Segment segment);
+
 /************************************ MAIN ************************************/
 
 /* The main function of your code goes here. */
@@ -33,109 +121,82 @@ static list_index first_free(const struct CircularList *list);
 // returns its index in the array.
 list_index insert_link(struct CircularList *list, struct CircularLink link) {
     // Sanity Check.
-    assert(list->length < CIRCULAR_LIST_MAX_LEN);
+    assert(list->length < list->capacity);
 
     // First of all, we store the link in the links array.
     list_index link_index = first_free(list);
-    list->links[link_index] = link;
+    links_of(list)[link_index] = link;
     // Marking the spot as taken.
-    list->used[link_index] = 1;
-    // Increasing the length of the list.
-    list->length++;
-    // From now on, we only care about the copy of the link which is stored in
-    // the links array.
-    struct CircularLink *link_ptr = &list->links[link_index];
-
-    // We first get the head link.
-    struct CircularLink *head_link = get_head(list);
-
-    // We have to find where to insert the link. Three cases appear:
-    //  1- The link contains the first address and should come before any
-    //  	other.
-    //  2- The link comes between two existing links.
-    //  3- The link comes after any existing links.
-    //
-    // Case 2 is easy to spot. For cases 1 and 3 we keep track of the links
-    // holding the lowest and highest addresses.
-
-    list_index highest_link = list->head;
-    block_ptr highest_address = end_of(head_link->segment);
-
-    list_index lowest_link = list->head;
-    block_ptr lowest_address = head_link->segment.start;
-
-    // We don't iterate beyong the length of the linked list (-1 because we
-    // already inspected the head link.
-    for (unsigned int i = 0; i < list->length; i++) {
-        // We get the next link.
-        struct CircularLink *adjacent_link = next_link(list, head_link);
-        // First case (easy case), link comes between the head_link and
-        // next_link.
-        if ((adjacent_link->segment.start < link_ptr->segment.start) &&
-            (link_ptr->segment.start < head_link->segment.start)) {
-            // Changing the "next" pointer of the two links.
-            link_ptr->next = head_link->next; // Pointer to next_link.
-            head_link->next = link_index;
-            // Early return.
-            return link_index;
-        } else {
-            // We update the min and max addresses if necessary.
-            if (adjacent_link->segment.start < lowest_address) {
-                lowest_address = adjacent_link->segment.start;
-                lowest_link = head_link->next;
-            } else if (end_of(adjacent_link->segment) > highest_address) {
-                highest_address = end_of(adjacent_link->segment);
-                highest_link = head_link->next;
-            }
-        }
+    bitmap_set(used_of(list), link_index);
+
+    // The links are also sorted in a tree, which lets us find the link that
+    // should come right before ours without walking the list.
+    tree_insert(list, link_index);
+    list_index previous_index = find_preceding(list, link.segment.start);
+
+    // The head always holds the lowest address, so if our link comes before
+    // it we should insert it after the highest link and make it the new head.
+    int is_lowest = previous_index == LIST_INDEX_NONE;
+    if (is_lowest) {
+        previous_index = tree_last(list);
     }
-    // If we reach this line, it means that our link is either the highest or
-    // lowest link in the CircularList.
-    if (link_ptr->segment.start < lowest_address) {
-        // Our link is going to become the lowest link. Because we don't know
-        // who pointed to the current lowest link, we are going to take his spot
-        // in the links array. We first have to move the current lowest link to
-        // the link_index.
-        list->links[link_index] = list->links[lowest_link];
-        // Copy is done, we can overwrite the original lowest link. We reuse the
-        // stack copy of the insterted link, since it has not been modified yet.
-        // We should point to the former lowest link, but it should keep the
-        // same destination.
-        link.next = link_index;
-        list->links[lowest_link] = link;
-        // We return the expected value.
-        return lowest_link;
-    } else {
-        // Our link is the new highest link. We should insert ourselves after
-        // the current highest link and before its destination.
-        struct CircularLink *former_highest_link = &list->links[highest_link];
-        link_ptr->next = former_highest_link->next;
-        former_highest_link->next = link_index;
-        // We return the expected value.
-        return link_index;
+
+    // Changing the "next" pointer of the two links.
+    links_of(list)[link_index].next = links_of(list)[previous_index].next;
+    links_of(list)[previous_index].next = link_index;
+    if (is_lowest) {
+        list->head = link_index;
     }
+    if (list->length == 0) {
+        // EDGE CASE
+        // The list was empty, the next-fit search starts from the only link.
+        list->rover = link_index;
+    }
+    // Increasing the length of the list.
+    list->length++;
+    list->free_blocks += link.segment.length;
+    // The new link also goes to its size class and to the maps.
+    bin_insert(list, link_index);
+    map_insert(list, BY_START, link_index);
+    map_insert(list, BY_END, link_index);
+    // We return the expected value.
+    return link_index;
 }
 
-// Used to remove a block in the CircularList and return it.
+// Used to remove a block in the CircularList and return it. The list may be left
+// empty when all the memory is allocated.
 struct CircularLink remove_link(struct CircularList *list, list_index index) {
     // Sanity Check;
-    assert(list->length > 1);
+    assert(list->length > 0);
 
     // We don't know who points to the current link, so we are going to the
     // "next" of the current link to take its place. We grab (and copy) the link
     // we will remove.
-    struct CircularLink removed_link = list->links[index];
-    list_index next_link_index = removed_link.next;
-    // We copy the link that comes after us.
-    list->links[index] = list->links[next_link_index];
-    // We free the space that was previously held by the other link.
-    list->used[next_link_index] = 0;
+    struct CircularLink removed_link = links_of(list)[index];
+    // The removed link leaves its size class, the tree and the maps before its
+    // spot is reused.
+    bin_remove(list, index);
+    tree_remove(list, index);
+    map_remove(list, BY_START, index);
+    map_remove(list, BY_END, index);
+    if (list->length == 1) {
+        // EDGE CASE
+        // The last link has no successor to take its spot, the list is empty.
+        bitmap_clear(used_of(list), index);
+        list->head = LIST_INDEX_NONE;
+        list->rover = LIST_INDEX_NONE;
+    } else {
+        // We copy the link that comes after us, this also frees the space that
+        // was previously held by the other link.
+        move_link(list, removed_link.next, index);
+    }
     // Decreasing the length of the list.
     list->length--;
+    list->free_blocks -= removed_link.segment.length;
 
     // Note that even if we were the head of the linked list, someone took our
-    // spot hence the head is still valid. So that means head could be 0 and
-    // just not exist...
+    // spot hence the head is still valid. If the link that took our spot was
+    // the head, move_link has updated the head as well.
     return removed_link;
 }
 
@@ -143,31 +204,356 @@ struct CircularLink remove_link(struct CircularList *list, list_index index) {
 struct CircularLink *next_link(struct CircularList *list,
                                const struct CircularLink *link) {
     // Using the list_index of the head link.
-    return &(list->links[link->next]);
+    return &(links_of(list)[link->next]);
 }
 
 // Creates a new CircularList from a single Segment.
 struct CircularList new_list(const struct Segment segment) {
-    // We first create a segment for the link, with list_index 0.
-    struct CircularLink first_link =
-        (struct CircularLink){.next = 0, .segment = segment};
-    // We then create a CircularList with only this link.
+    // The list uses its own arrays, which NULL pointers stand for.
     struct CircularList list;
-    list.length = 1;
-    list.head = 0; // The link at address 0 is first_link and thus valid.
-    list.links[0] = first_link;
-    // Only the first list_index is used.
-    list.used[0] = 1;
-    for (list_index i = 1; i < sizeof(list.used); i++) {
-        list.used[i] = 0;
-    }
+    list.capacity = CIRCULAR_LIST_MAX_LEN;
+    list.map_len = CIRCULAR_LIST_MAP_LEN;
+    list.links = NULL;
+    list.used = NULL;
+    list.start_map = NULL;
+    list.end_map = NULL;
+    init_list(&list, segment);
     // Returning the CircularList.
     return list;
 }
 
+// Creates a new CircularList from a single Segment, storing up to capacity
+// links in the given metadata buffer of list_metadata_size(capacity) bytes.
+struct CircularList new_list_in(const struct Segment segment, void *metadata,
+                                unsigned int capacity) {
+    struct CircularList list;
+    list.capacity = capacity;
+    list.map_len = hash_len_for(capacity);
+    carve_metadata(&list, metadata);
+    init_list(&list, segment);
+    // Returning the CircularList.
+    return list;
+}
+
+// Returns the number of bytes of metadata needed by a CircularList holding up
+// to capacity links.
+size_t list_metadata_size(unsigned int capacity) {
+    // The bitmap comes first since it has the strictest alignment.
+    return BITMAP_WORDS(capacity) * sizeof(bitmap_word) +
+           capacity * sizeof(struct CircularLink) +
+           2 * hash_len_for(capacity) * sizeof(list_index);
+}
+
+// Points the arrays of the list into a metadata buffer which already holds
+// them, such as one saved by a former process. The other fields of the list
+// should already be set.
+void attach_list(struct CircularList *list, void *metadata) {
+    carve_metadata(list, metadata);
+}
+
+// Empties the list but for a single link holding the given Segment, keeping
+// its storage and capacity.
+void reset_list(struct CircularList *list, const struct Segment segment) {
+    // The searches made so far still count.
+    unsigned long long visited = list->visited;
+    init_list(list, segment);
+    list->visited = visited;
+}
+
+// Moves the links of the list to a new metadata buffer of
+// list_metadata_size(capacity) bytes. The capacity cannot shrink, and the
+// former buffer can be reused once this returns.
+void move_list_to(struct CircularList *list, void *metadata,
+                  unsigned int capacity) {
+    // Sanity check.
+    assert(capacity >= list->capacity);
+    const struct CircularLink *former_links = links_of(list);
+    const bitmap_word *former_used = used_of(list);
+    unsigned int former_capacity = list->capacity;
+
+    list->capacity = capacity;
+    list->map_len = hash_len_for(capacity);
+    carve_metadata(list, metadata);
+
+    // The links keep their index, so the list, the size classes and the tree
+    // are still valid once copied.
+    bitmap_reset(used_of(list), capacity);
+    for (unsigned int i = 0; i < BITMAP_WORDS(former_capacity); i++) {
+        used_of(list)[i] = former_used[i];
+    }
+    for (list_index i = 0; i < former_capacity; i++) {
+        links_of(list)[i] = former_links[i];
+    }
+    // The maps however depend on their length, so they are built again.
+    for (unsigned int i = 0; i < list->map_len; i++) {
+        map_of(list, BY_START)[i] = LIST_INDEX_NONE;
+        map_of(list, BY_END)[i] = LIST_INDEX_NONE;
+    }
+    for (list_index i = 0; i < capacity; i++) {
+        if (bitmap_get(used_of(list), i)) {
+            map_insert(list, BY_START, i);
+            map_insert(list, BY_END, i);
+        }
+    }
+}
+
+// Gets the link at the given index.
+struct CircularLink *get_link(struct CircularList *list, list_index index) {
+    return &(links_of(list)[index]);
+}
+
 // Gets the head of the list.
 struct CircularLink *get_head(struct CircularList *list) {
-    return &(list->links[list->head]);
+    return &(links_of(list)[list->head]);
+}
+
+// Returns the size class of a segment with the given length.
+unsigned int size_class(unsigned int length) {
+    // Sanity check, empty segments have no size class.
+    assert(length > 0);
+    // The size class is the index of the highest bit set.
+    return (sizeof(unsigned int) * 8 - 1) - __builtin_clz(length);
+}
+
+// Returns the index of a link holding at least size blocks, or LIST_INDEX_NONE
+// if there is none. The smallest size class whose links are all big enough is
+// searched first, in constant time.
+list_index find_fit(struct CircularList *list, unsigned int size) {
+    unsigned int bin = size_class(size);
+    if ((size & (size - 1)) == 0) {
+        // EDGE CASE
+        // For a power of two, every link in its own size class is big enough.
+        if (list->bins[bin] != LIST_INDEX_NONE) {
+            list->visited++;
+            return list->bins[bin];
+        }
+    }
+    // Any link from a bigger size class is big enough, we take the first link
+    // of the smallest non-empty one.
+    unsigned int bigger_bins = list->bin_mask & ~((2u << bin) - 1);
+    if (bigger_bins != 0) {
+        list->visited++;
+        return list->bins[__builtin_ctz(bigger_bins)];
+    }
+    // The links in the size class of size may or may not be big enough. A few
+    // of them are checked one by one, then the tree finds one if it exists.
+    unsigned int scanned = 0;
+    for (list_index index = list->bins[bin];
+         (index != LIST_INDEX_NONE) && (scanned < CIRCULAR_LIST_BIN_SCAN);
+         index = links_of(list)[index].bin_next) {
+        list->visited++;
+        scanned++;
+        if (links_of(list)[index].segment.length >= size) {
+            return index;
+        }
+    }
+    if (scanned < CIRCULAR_LIST_BIN_SCAN) {
+        // The whole size class was checked, no free segment is big enough.
+        return LIST_INDEX_NONE;
+    }
+    return find_first_fit(list, size);
+}
+
+// Returns the index of the link with the lowest address holding at least size
+// blocks, or LIST_INDEX_NONE if there is none.
+list_index find_first_fit(struct CircularList *list, unsigned int size) {
+    // The tree knows the longest Segment of each subtree, so we can go
+    // straight to the leftmost link which is big enough.
+    return tree_first_fit(list, list->tree_root, 0, size);
+}
+
+// Returns the index of the first link holding at least size blocks, starting
+// from where the previous next-fit search stopped, or LIST_INDEX_NONE if there
+// is none.
+list_index find_next_fit(struct CircularList *list, unsigned int size) {
+    if (list->length == 0) {
+        // EDGE CASE
+        // There is no rover to start from.
+        return LIST_INDEX_NONE;
+    }
+    // Going around the list from the rover is the same as looking for the
+    // first fit at or after the rover, and then for the first fit before it.
+    list_index index = tree_first_fit(list, list->tree_root,
+                                      links_of(list)[list->rover].segment.start,
+                                      size);
+    if (index == LIST_INDEX_NONE) {
+        index = tree_first_fit(list, list->tree_root, 0, size);
+    }
+    if (index != LIST_INDEX_NONE) {
+        // The next search starts from the link we have found. Should this
+        // link be removed, the link that takes its spot is its successor,
+        // which is where the search should start anyway.
+        list->rover = index;
+    }
+    return index;
+}
+
+// Returns the index of the smallest link holding at least size blocks, or
+// LIST_INDEX_NONE if there is none.
+list_index find_best_fit(struct CircularList *list, unsigned int size) {
+    unsigned int bin = size_class(size);
+    // If some links of the size class of size are big enough, the smallest of
+    // them is the best fit since bigger size classes only hold bigger links.
+    // Otherwise the best fit is the smallest link of the smallest non-empty
+    // bigger size class.
+    unsigned int bigger_bins = list->bin_mask & ~((2u << bin) - 1);
+    unsigned int candidate_bins[2] = {
+        bin, (bigger_bins == 0) ? bin : (unsigned int)__builtin_ctz(bigger_bins)};
+    for (unsigned int i = 0; i < 2; i++) {
+        list_index best_index = LIST_INDEX_NONE;
+        for (list_index index = list->bins[candidate_bins[i]];
+             index != LIST_INDEX_NONE; index = links_of(list)[index].bin_next) {
+            list->visited++;
+            unsigned int length = links_of(list)[index].segment.length;
+            if ((length >= size) &&
+                ((best_index == LIST_INDEX_NONE) ||
+                 (length < links_of(list)[best_index].segment.length))) {
+                best_index = index;
+            }
+        }
+        if (best_index != LIST_INDEX_NONE) {
+            return best_index;
+        }
+    }
+    // No free segment is big enough.
+    return LIST_INDEX_NONE;
+}
+
+// Returns the index of the biggest link if it holds at least size blocks, or
+// LIST_INDEX_NONE otherwise.
+list_index find_worst_fit(struct CircularList *list, unsigned int size) {
+    // The root of the tree knows the length of the biggest link.
+    unsigned int worst_length = longest_link(list);
+    if (worst_length < size) {
+        // Even the biggest free segment is too small.
+        return LIST_INDEX_NONE;
+    }
+    // We follow the subtrees holding the biggest link until we reach it.
+    list_index index = list->tree_root;
+    list->visited++;
+    while (links_of(list)[index].segment.length != worst_length) {
+        list->visited++;
+        list_index left = links_of(list)[index].tree_left;
+        if (subtree_max(list, left) == worst_length) {
+            index = left;
+        } else {
+            index = links_of(list)[index].tree_right;
+        }
+    }
+    return index;
+}
+
+// Returns the index of the link with the lowest address holding size blocks
+// starting at a multiple of alignment, which must be a power of two, or
+// LIST_INDEX_NONE if there is none.
+list_index find_aligned_fit(struct CircularList *list, unsigned int size,
+                            unsigned int alignment) {
+    // The links holding size blocks are visited by increasing address until
+    // one of them also holds the padding needed to reach an aligned start. The
+    // walk stops at the latest on a link holding size + alignment - 1 blocks.
+    block_ptr from = 0;
+    while (1) {
+        list_index index = tree_first_fit(list, list->tree_root, from, size);
+        if (index == LIST_INDEX_NONE) {
+            return LIST_INDEX_NONE;
+        }
+        struct Segment segment = links_of(list)[index].segment;
+        unsigned int padding = (0u - segment.start) & (alignment - 1);
+        if (segment.length - size >= padding) {
+            return index;
+        }
+        from = segment.start + 1;
+    }
+}
+
+// Returns the length of the longest Segment in the list.
+unsigned int longest_link(const struct CircularList *list) {
+    return subtree_max(list, list->tree_root);
+}
+
+// Returns the index of the link with the highest start address below the given
+// address, or LIST_INDEX_NONE if there is none.
+list_index find_preceding(const struct CircularList *list, block_ptr address) {
+    list_index preceding = LIST_INDEX_NONE;
+    list_index index = list->tree_root;
+    while (index != LIST_INDEX_NONE) {
+        if (links_of(list)[index].segment.start < address) {
+            // This link is a candidate, but there may be a closer one.
+            preceding = index;
+            index = links_of(list)[index].tree_right;
+        } else {
+            index = links_of(list)[index].tree_left;
+        }
+    }
+    return preceding;
+}
+
+// Returns the index of the link with the lowest start address at or above the
+// given address, or LIST_INDEX_NONE if there is none.
+list_index find_following(const struct CircularList *list, block_ptr address) {
+    list_index following = LIST_INDEX_NONE;
+    list_index index = list->tree_root;
+    while (index != LIST_INDEX_NONE) {
+        if (links_of(list)[index].segment.start >= address) {
+            // This link is a candidate, but there may be a closer one.
+            following = index;
+            index = links_of(list)[index].tree_left;
+        } else {
+            index = links_of(list)[index].tree_right;
+        }
+    }
+    return following;
+}
+
+// Returns the index of the link whose Segment starts at the given address, or
+// LIST_INDEX_NONE if there is none.
+list_index find_starting_at(const struct CircularList *list,
+                            block_ptr address) {
+    // A free spot holds LIST_INDEX_NONE, which is what we should return.
+    return map_of(list, BY_START)[map_spot(list, BY_START, address)];
+}
+
+// Returns the index of the link whose Segment ends at the given address, or
+// LIST_INDEX_NONE if there is none.
+list_index find_ending_at(const struct CircularList *list, block_ptr address) {
+    // A free spot holds LIST_INDEX_NONE, which is what we should return.
+    return map_of(list, BY_END)[map_spot(list, BY_END, address)];
+}
+
+// Replaces the Segment of the link at the given index, moving the link to the
+// right size class. The new Segment must keep the list sorted.
+void resize_link(struct CircularList *list, list_index index,
+                 const struct Segment segment) {
+    struct CircularLink *link = &links_of(list)[index];
+    list->free_blocks += segment.length - link->segment.length;
+    // The maps are keyed by the Segment, so the link has to leave them while
+    // its Segment changes.
+    int start_changed = link->segment.start != segment.start;
+    int end_changed = end_of(link->segment) != end_of(segment);
+    if (start_changed) {
+        map_remove(list, BY_START, index);
+    }
+    if (end_changed) {
+        map_remove(list, BY_END, index);
+    }
+    if (size_class(link->segment.length) == size_class(segment.length)) {
+        // The link stays in the same size class.
+        link->segment = segment;
+    } else {
+        // The link has to change size class.
+        bin_remove(list, index);
+        link->segment = segment;
+        bin_insert(list, index);
+    }
+    if (start_changed) {
+        map_insert(list, BY_START, index);
+    }
+    if (end_changed) {
+        map_insert(list, BY_END, index);
+    }
+    // Since the list stays sorted, the tree only has to update the longest
+    // Segment of the subtrees holding the link.
+    tree_update(list, index);
 }
 
 // Internal functions.
@@ -175,21 +561,411 @@ struct CircularLink *get_head(struct CircularList *list) {
 // Returns the first free spot to add a new link in the CircularList.
 static list_index first_free(const struct CircularList *list) {
     // Sanity check.
-    assert(list->length < CIRCULAR_LIST_MAX_LEN);
-
-    // Searching free spot.
-    list_index free_index = 0;
-    while (free_index < CIRCULAR_LIST_MAX_LEN) {
-        if (list->used[free_index] == 0) {
-            // We have found an empty spot.
-            return free_index;
+    assert(list->length < list->capacity);
+
+    // Searching free spot, a whole word of the bitmap at a time.
+    list_index free_index =
+        bitmap_find_clear(used_of(list), list->capacity, 0);
+    // Will never happen, the callers make room first.
+    assert(free_index < list->capacity);
+    return free_index;
+}
+
+// Adds the link at the given index to the front of its size class.
+static void bin_insert(struct CircularList *list, list_index index) {
+    struct CircularLink *link = &links_of(list)[index];
+    unsigned int bin = size_class(link->segment.length);
+    // The link becomes the first of its size class.
+    link->bin_prev = LIST_INDEX_NONE;
+    link->bin_next = list->bins[bin];
+    if (link->bin_next != LIST_INDEX_NONE) {
+        links_of(list)[link->bin_next].bin_prev = index;
+    }
+    list->bins[bin] = index;
+    // The size class is not empty anymore.
+    list->bin_mask |= 1u << bin;
+}
+
+// Removes the link at the given index from its size class.
+static void bin_remove(struct CircularList *list, list_index index) {
+    struct CircularLink *link = &links_of(list)[index];
+    unsigned int bin = size_class(link->segment.length);
+    // Unlinking from the previous link, or from the size class itself.
+    if (link->bin_prev != LIST_INDEX_NONE) {
+        links_of(list)[link->bin_prev].bin_next = link->bin_next;
+    } else {
+        list->bins[bin] = link->bin_next;
+    }
+    // Unlinking from the next link.
+    if (link->bin_next != LIST_INDEX_NONE) {
+        links_of(list)[link->bin_next].bin_prev = link->bin_prev;
+    }
+    // Clearing the presence bit of now empty size classes.
+    if (list->bins[bin] == LIST_INDEX_NONE) {
+        list->bin_mask &= ~(1u << bin);
+    }
+}
+
+// Moves a link to another spot of the links array, updating everything that
+// referenced its former spot except the "next" pointer of its predecessor.
+static void move_link(struct CircularList *list, list_index from,
+                      list_index to) {
+    // Copying the link, the former spot is free from now on.
+    struct CircularLink *link = &links_of(list)[to];
+    *link = links_of(list)[from];
+    bitmap_clear(used_of(list), from);
+    // The neighbours within the size class should point to the new spot.
+    if (link->bin_prev != LIST_INDEX_NONE) {
+        links_of(list)[link->bin_prev].bin_next = to;
+    } else {
+        list->bins[size_class(link->segment.length)] = to;
+    }
+    if (link->bin_next != LIST_INDEX_NONE) {
+        links_of(list)[link->bin_next].bin_prev = to;
+    }
+    // And so should its neighbours within the tree.
+    if (link->tree_parent == LIST_INDEX_NONE) {
+        list->tree_root = to;
+    } else if (links_of(list)[link->tree_parent].tree_left == from) {
+        links_of(list)[link->tree_parent].tree_left = to;
+    } else {
+        links_of(list)[link->tree_parent].tree_right = to;
+    }
+    if (link->tree_left != LIST_INDEX_NONE) {
+        links_of(list)[link->tree_left].tree_parent = to;
+    }
+    if (link->tree_right != LIST_INDEX_NONE) {
+        links_of(list)[link->tree_right].tree_parent = to;
+    }
+    // The maps should find the link at its new spot.
+    map_of(list, BY_START)[map_spot(list, BY_START, link->segment.start)] = to;
+    map_of(list, BY_END)[map_spot(list, BY_END, end_of(link->segment))] = to;
+    // So should the head and the rover.
+    if (list->head == from) {
+        list->head = to;
+    }
+    if (list->rover == from) {
+        list->rover = to;
+    }
+}
+
+// Returns the longest Segment in the subtree of the given link, 0 for an empty
+// subtree.
+static unsigned int subtree_max(const struct CircularList *list,
+                                list_index index) {
+    return (index == LIST_INDEX_NONE) ? 0 : links_of(list)[index].max_length;
+}
+
+// Adds the link at the given index to the address tree.
+static void tree_insert(struct CircularList *list, list_index index) {
+    struct CircularLink *link = &links_of(list)[index];
+    // Drawing a random priority with a xorshift generator.
+    list->seed ^= list->seed << 13;
+    list->seed ^= list->seed >> 17;
+    list->seed ^= list->seed << 5;
+    link->priority = list->seed;
+    link->tree_left = LIST_INDEX_NONE;
+    link->tree_right = LIST_INDEX_NONE;
+    link->max_length = link->segment.length;
+
+    // We first insert the link as a leaf, updating the longest Segment of the
+    // subtrees we go through.
+    list_index parent = LIST_INDEX_NONE;
+    list_index current = list->tree_root;
+    while (current != LIST_INDEX_NONE) {
+        struct CircularLink *current_link = &links_of(list)[current];
+        if (current_link->max_length < link->segment.length) {
+            current_link->max_length = link->segment.length;
+        }
+        parent = current;
+        if (link->segment.start < current_link->segment.start) {
+            current = current_link->tree_left;
+        } else {
+            current = current_link->tree_right;
+        }
+    }
+    link->tree_parent = parent;
+    if (parent == LIST_INDEX_NONE) {
+        list->tree_root = index;
+    } else if (link->segment.start < links_of(list)[parent].segment.start) {
+        links_of(list)[parent].tree_left = index;
+    } else {
+        links_of(list)[parent].tree_right = index;
+    }
+
+    // Then we move it up until the priorities are sorted again, which keeps
+    // the tree balanced on average.
+    while ((link->tree_parent != LIST_INDEX_NONE) &&
+           (links_of(list)[link->tree_parent].priority < link->priority)) {
+        tree_rotate_up(list, index);
+    }
+}
+
+// Removes the link at the given index from the address tree.
+static void tree_remove(struct CircularList *list, list_index index) {
+    struct CircularLink *link = &links_of(list)[index];
+    // We move the link down until it becomes a leaf, always promoting the
+    // child with the highest priority to keep the priorities sorted.
+    while ((link->tree_left != LIST_INDEX_NONE) ||
+           (link->tree_right != LIST_INDEX_NONE)) {
+        list_index child;
+        if (link->tree_left == LIST_INDEX_NONE) {
+            child = link->tree_right;
+        } else if (link->tree_right == LIST_INDEX_NONE) {
+            child = link->tree_left;
+        } else if (links_of(list)[link->tree_left].priority >
+                   links_of(list)[link->tree_right].priority) {
+            child = link->tree_left;
         } else {
-            // Checking the next spot.
-            free_index++;
+            child = link->tree_right;
+        }
+        tree_rotate_up(list, child);
+    }
+    // A leaf can simply be detached from its parent.
+    list_index parent = link->tree_parent;
+    if (parent == LIST_INDEX_NONE) {
+        list->tree_root = LIST_INDEX_NONE;
+        return;
+    } else if (links_of(list)[parent].tree_left == index) {
+        links_of(list)[parent].tree_left = LIST_INDEX_NONE;
+    } else {
+        links_of(list)[parent].tree_right = LIST_INDEX_NONE;
+    }
+    // The subtrees which held the link may have lost their longest Segment.
+    tree_update(list, parent);
+}
+
+// Updates the longest Segment of the subtrees holding the link at the given
+// index, after its Segment has changed.
+static void tree_update(struct CircularList *list, list_index index) {
+    while (index != LIST_INDEX_NONE) {
+        struct CircularLink *link = &links_of(list)[index];
+        unsigned int max_length = link->segment.length;
+        if (subtree_max(list, link->tree_left) > max_length) {
+            max_length = subtree_max(list, link->tree_left);
+        }
+        if (subtree_max(list, link->tree_right) > max_length) {
+            max_length = subtree_max(list, link->tree_right);
+        }
+        if (max_length == link->max_length) {
+            // The subtrees above are not affected either.
+            return;
         }
+        link->max_length = max_length;
+        index = link->tree_parent;
+    }
+}
+
+// Moves the link at the given index one level up in the tree, in place of its
+// parent.
+static void tree_rotate_up(struct CircularList *list, list_index index) {
+    struct CircularLink *link = &links_of(list)[index];
+    list_index parent = link->tree_parent;
+    struct CircularLink *parent_link = &links_of(list)[parent];
+    list_index grandparent = parent_link->tree_parent;
+
+    // The subtree between the link and its parent changes side.
+    list_index middle;
+    if (parent_link->tree_left == index) {
+        middle = link->tree_right;
+        parent_link->tree_left = middle;
+        link->tree_right = parent;
+    } else {
+        middle = link->tree_left;
+        parent_link->tree_right = middle;
+        link->tree_left = parent;
+    }
+    if (middle != LIST_INDEX_NONE) {
+        links_of(list)[middle].tree_parent = parent;
+    }
+    parent_link->tree_parent = index;
+
+    // The link takes the place of its parent.
+    link->tree_parent = grandparent;
+    if (grandparent == LIST_INDEX_NONE) {
+        list->tree_root = index;
+    } else if (links_of(list)[grandparent].tree_left == parent) {
+        links_of(list)[grandparent].tree_left = index;
+    } else {
+        links_of(list)[grandparent].tree_right = index;
+    }
+
+    // The link now holds the whole subtree of its former parent, while the
+    // parent has to be recomputed from its new children.
+    link->max_length = parent_link->max_length;
+    parent_link->max_length = parent_link->segment.length;
+    if (subtree_max(list, parent_link->tree_left) > parent_link->max_length) {
+        parent_link->max_length = subtree_max(list, parent_link->tree_left);
+    }
+    if (subtree_max(list, parent_link->tree_right) > parent_link->max_length) {
+        parent_link->max_length = subtree_max(list, parent_link->tree_right);
+    }
+}
+
+// Returns the leftmost link of the subtree at index which holds at least size
+// blocks and starts at or after the from address, or LIST_INDEX_NONE.
+static list_index tree_first_fit(struct CircularList *list, list_index index,
+                                 block_ptr from, unsigned int size) {
+    if (subtree_max(list, index) < size) {
+        // No link of this subtree is big enough, which includes empty ones.
+        return LIST_INDEX_NONE;
+    }
+    list->visited++;
+    const struct CircularLink *link = &links_of(list)[index];
+    if (link->segment.start >= from) {
+        // Links on the left come first, if any of them is suitable.
+        list_index found = tree_first_fit(list, link->tree_left, from, size);
+        if (found != LIST_INDEX_NONE) {
+            return found;
+        } else if (link->segment.length >= size) {
+            return index;
+        }
+    }
+    // Otherwise only the links on the right are left.
+    return tree_first_fit(list, link->tree_right, from, size);
+}
+
+// Returns the index of the link with the highest address.
+static list_index tree_last(const struct CircularList *list) {
+    list_index index = list->tree_root;
+    while (links_of(list)[index].tree_right != LIST_INDEX_NONE) {
+        index = links_of(list)[index].tree_right;
+    }
+    return index;
+}
+
+// Returns the address a link is keyed by in a map, its start for the
+// start_map and its end for the end_map.
+static block_ptr key_of(const struct CircularList *list, enum MapKey key,
+                        list_index index) {
+    if (key == BY_START) {
+        return links_of(list)[index].segment.start;
+    } else {
+        return end_of(links_of(list)[index].segment);
+    }
+}
+
+// Returns the spot of the map holding the link keyed by the given address, or
+// the free spot where it would go.
+static unsigned int map_spot(const struct CircularList *list, enum MapKey key,
+                             block_ptr address) {
+    const list_index *map = map_of(list, key);
+    // The maps always have free spots, so this terminates.
+    unsigned int spot = hash_of(address, list->map_len);
+    while ((map[spot] != LIST_INDEX_NONE) &&
+           (key_of(list, key, map[spot]) != address)) {
+        spot = (spot + 1) & (list->map_len - 1);
+    }
+    return spot;
+}
+
+// Adds the link at the given index to a map.
+static void map_insert(struct CircularList *list, enum MapKey key,
+                       list_index index) {
+    map_of(list, key)[map_spot(list, key, key_of(list, key, index))] = index;
+}
+
+// Removes the link at the given index from a map, keeping the following links
+// reachable from their home spot.
+static void map_remove(struct CircularList *list, enum MapKey key,
+                       list_index index) {
+    list_index *map = map_of(list, key);
+    const unsigned int mask = list->map_len - 1;
+    // The spot of the link is now a hole in the map.
+    unsigned int hole = map_spot(list, key, key_of(list, key, index));
+    map[hole] = LIST_INDEX_NONE;
+    // The links placed after the hole may have been pushed past it by a
+    // collision. We move them back into the hole when it lies between their
+    // home and their current spot.
+    for (unsigned int next = (hole + 1) & mask; map[next] != LIST_INDEX_NONE;
+         next = (next + 1) & mask) {
+        unsigned int home = hash_of(key_of(list, key, map[next]), list->map_len);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map[hole] = map[next];
+            map[next] = LIST_INDEX_NONE;
+            hole = next;
+        }
+    }
+}
+
+// Returns the links of the list, wherever they are stored.
+static struct CircularLink *links_of(const struct CircularList *list) {
+    if (list->links == NULL) {
+        return (struct CircularLink *)list->inline_links;
+    }
+    return list->links;
+}
+
+// Returns the bitmap of the used links, wherever it is stored.
+static bitmap_word *used_of(const struct CircularList *list) {
+    if (list->used == NULL) {
+        return (bitmap_word *)list->inline_used;
+    }
+    return list->used;
+}
+
+// Returns one of the maps of the list, wherever it is stored.
+static list_index *map_of(const struct CircularList *list, enum MapKey key) {
+    if (key == BY_START) {
+        if (list->start_map == NULL) {
+            return (list_index *)list->inline_start_map;
+        }
+        return list->start_map;
+    } else {
+        if (list->end_map == NULL) {
+            return (list_index *)list->inline_end_map;
+        }
+        return list->end_map;
+    }
+}
+
+// Points the arrays of the list into a metadata buffer, according to its
+// capacity and the length of its maps.
+static void carve_metadata(struct CircularList *list, void *metadata) {
+    // Sanity check, the bitmap words need to be aligned.
+    assert(((uintptr_t)metadata % sizeof(bitmap_word)) == 0);
+    char *cursor = metadata;
+    list->used = (bitmap_word *)cursor;
+    cursor += BITMAP_WORDS(list->capacity) * sizeof(bitmap_word);
+    list->links = (struct CircularLink *)cursor;
+    cursor += list->capacity * sizeof(struct CircularLink);
+    list->start_map = (list_index *)cursor;
+    cursor += list->map_len * sizeof(list_index);
+    list->end_map = (list_index *)cursor;
+}
+
+// Sets up an empty list of known capacity and storage with a single link
+// holding the given Segment.
+static void init_list(struct CircularList *list, const struct Segment segment) {
+    // We first create a segment for the link, with list_index 0.
+    struct CircularLink first_link =
+        (struct CircularLink){.next = 0, .segment = segment};
+    // We then create a CircularList with only this link.
+    list->length = 1;
+    list->head = 0; // The link at address 0 is first_link and thus valid.
+    list->rover = 0;
+    list->free_blocks = segment.length;
+    list->visited = 0;
+    links_of(list)[0] = first_link;
+    // Only the first list_index is used.
+    bitmap_reset(used_of(list), list->capacity);
+    bitmap_set(used_of(list), 0);
+    // All the size classes are empty, except the one of the first link.
+    for (unsigned int i = 0; i < CIRCULAR_LIST_BIN_COUNT; i++) {
+        list->bins[i] = LIST_INDEX_NONE;
+    }
+    list->bin_mask = 0;
+    bin_insert(list, 0);
+    // The first link is also alone in the tree and in the maps.
+    list->tree_root = LIST_INDEX_NONE;
+    list->seed = 2463534242u;
+    tree_insert(list, 0);
+    for (unsigned int i = 0; i < list->map_len; i++) {
+        map_of(list, BY_START)[i] = LIST_INDEX_NONE;
+        map_of(list, BY_END)[i] = LIST_INDEX_NONE;
     }
-    // Will never happen.
-    assert(0);
+    map_insert(list, BY_START, 0);
+    map_insert(list, BY_END, 0);
 }
 
 /************************************ EOF *************************************/
@@ -0,0 +1,311 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "concurrent_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+/*********************************** MACROS ***********************************/
+
+// The lookups rely on the length of the map being a power of two.
+_Static_assert((CONCURRENT_MAP_LEN & (CONCURRENT_MAP_LEN - 1)) == 0,
+               "CONCURRENT_MAP_LEN must be a power of two");
+
+// Returned by the map when a segment was not carved for the thread caches.
+#define NO_CLASS ((unsigned int)-1)
+
+/********************************** STRUCTS ***********************************/
+
+// The free segments kept by a thread for one ConcurrentAllocator.
+struct ThreadCache {
+    struct ConcurrentAllocator *owner; // The allocator the segments come from.
+    unsigned int lengths[CONCURRENT_CLASS_COUNT]; // The number of segments of
+                                                  // each size class.
+    block_ptr segments[CONCURRENT_CLASS_COUNT]
+                      [CONCURRENT_CACHE_LEN]; // The cached segments.
+};
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the cache of the calling thread, bound to the given allocator.
+static struct ThreadCache *cache_for(struct ConcurrentAllocator *concurrent);
+
+// Gives all the segments of a thread cache back to its owner.
+static void flush_cache(void *cache);
+
+// Moves up to count segments of the given size class from the cache to the
+// shared Allocator.
+static void flush_class(struct ThreadCache *cache, unsigned int class_index,
+                        unsigned int count);
+
+// Moves a batch of new segments of the given size class from the shared
+// Allocator to the cache.
+static void refill_class(struct ThreadCache *cache, unsigned int class_index);
+
+// Returns the size class of a segment carved for the thread caches, or
+// NO_CLASS. Safe to call without the lock.
+static unsigned int map_find(struct ConcurrentAllocator *concurrent,
+                             block_ptr allocated);
+
+// Records the size class of a segment carved for the thread caches.
+static void map_insert(struct ConcurrentAllocator *concurrent,
+                       block_ptr allocated, unsigned int class_index);
+
+// Forgets a segment carved for the thread caches.
+static void map_remove(struct ConcurrentAllocator *concurrent,
+                       block_ptr allocated);
+
+/*********************************** GLOBALS **********************************/
+
+// The cache of each thread.
+static _Thread_local struct ThreadCache thread_cache;
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Sets up a ConcurrentAllocator in place around an existing Allocator.
+void init_concurrent_allocator(struct ConcurrentAllocator *concurrent,
+                               const struct Allocator allocator) {
+    pthread_mutex_init(&concurrent->lock, NULL);
+    concurrent->allocator = allocator;
+    // Threads holding a cache flush it when they exit.
+    pthread_key_create(&concurrent->thread_key, flush_cache);
+    concurrent->mapped = 0;
+    for (unsigned int i = 0; i < CONCURRENT_MAP_LEN; i++) {
+        atomic_init(&concurrent->class_map[i], 0);
+    }
+}
+
+// Releases the resources of a ConcurrentAllocator. All the threads should have
+// called concurrent_flush or exited beforehand.
+void destroy_concurrent_allocator(struct ConcurrentAllocator *concurrent) {
+    // The cache of the calling thread is the only one we can reach.
+    concurrent_flush(concurrent);
+    pthread_key_delete(concurrent->thread_key);
+    pthread_mutex_destroy(&concurrent->lock);
+}
+
+// Thread-safe block_malloc.
+block_ptr concurrent_malloc(struct ConcurrentAllocator *concurrent,
+                            unsigned int size) {
+    unsigned int class_index = (size <= 1) ? 0 : size_class(size - 1) + 1;
+    if (class_index >= CONCURRENT_CLASS_COUNT) {
+        // Big segments are not cached, they come from the shared Allocator.
+        pthread_mutex_lock(&concurrent->lock);
+        block_ptr allocated = block_malloc(&concurrent->allocator, size);
+        pthread_mutex_unlock(&concurrent->lock);
+        return allocated;
+    }
+    struct ThreadCache *cache = cache_for(concurrent);
+    if (cache->lengths[class_index] == 0) {
+        refill_class(cache, class_index);
+    }
+    if (cache->lengths[class_index] == 0) {
+        // Either the map is full, so the segment cannot be cached later on, or
+        // the memory is. We allocate exactly what was asked instead.
+        pthread_mutex_lock(&concurrent->lock);
+        block_ptr allocated = block_malloc(&concurrent->allocator, size);
+        pthread_mutex_unlock(&concurrent->lock);
+        return allocated;
+    }
+    // The common case, no lock needed.
+    cache->lengths[class_index]--;
+    return cache->segments[class_index][cache->lengths[class_index]];
+}
+
+// Thread-safe block_free.
+void concurrent_free(struct ConcurrentAllocator *concurrent,
+                     block_ptr allocated) {
+    unsigned int class_index = map_find(concurrent, allocated);
+    if (class_index == NO_CLASS) {
+        // Either the segment was not carved for the caches, or the map was
+        // being updated while we read it. We check again with the lock.
+        pthread_mutex_lock(&concurrent->lock);
+        class_index = map_find(concurrent, allocated);
+        if (class_index == NO_CLASS) {
+            block_free(&concurrent->allocator, allocated);
+            pthread_mutex_unlock(&concurrent->lock);
+            return;
+        }
+        pthread_mutex_unlock(&concurrent->lock);
+    }
+    struct ThreadCache *cache = cache_for(concurrent);
+    if (cache->lengths[class_index] == CONCURRENT_CACHE_LEN) {
+        // The cache is full, we give a batch of segments back.
+        flush_class(cache, class_index, CONCURRENT_BATCH_LEN);
+    }
+    // The common case, no lock needed.
+    cache->segments[class_index][cache->lengths[class_index]] = allocated;
+    cache->lengths[class_index]++;
+}
+
+// Gives the segments cached by the calling thread back to the shared
+// Allocator.
+void concurrent_flush(struct ConcurrentAllocator *concurrent) {
+    if (thread_cache.owner == concurrent) {
+        flush_cache(&thread_cache);
+        pthread_setspecific(concurrent->thread_key, NULL);
+    }
+}
+
+// Internal functions.
+
+// Returns the cache of the calling thread, bound to the given allocator.
+static struct ThreadCache *cache_for(struct ConcurrentAllocator *concurrent) {
+    struct ThreadCache *cache = &thread_cache;
+    if (cache->owner != concurrent) {
+        // A thread only caches segments for one allocator at a time.
+        if (cache->owner != NULL) {
+            concurrent_flush(cache->owner);
+        }
+        cache->owner = concurrent;
+        // The cache should be flushed when the thread exits.
+        pthread_setspecific(concurrent->thread_key, cache);
+    }
+    return cache;
+}
+
+// Gives all the segments of a thread cache back to its owner.
+static void flush_cache(void *cache_ptr) {
+    struct ThreadCache *cache = cache_ptr;
+    for (unsigned int i = 0; i < CONCURRENT_CLASS_COUNT; i++) {
+        flush_class(cache, i, cache->lengths[i]);
+    }
+    cache->owner = NULL;
+}
+
+// Moves up to count segments of the given size class from the cache to the
+// shared Allocator.
+static void flush_class(struct ThreadCache *cache, unsigned int class_index,
+                        unsigned int count) {
+    struct ConcurrentAllocator *concurrent = cache->owner;
+    if (count > cache->lengths[class_index]) {
+        count = cache->lengths[class_index];
+    }
+    if (count == 0) {
+        return;
+    }
+    // The oldest segments go first, the most recent ones are more likely to
+    // be reused soon.
+    pthread_mutex_lock(&concurrent->lock);
+    for (unsigned int i = 0; i < count; i++) {
+        map_remove(concurrent, cache->segments[class_index][i]);
+    }
+    // Segments carved from the same batch are merged before going back.
+    block_free_n(&concurrent->allocator, cache->segments[class_index], count);
+    pthread_mutex_unlock(&concurrent->lock);
+    // The remaining segments move to the bottom of the cache.
+    unsigned int remaining = cache->lengths[class_index] - count;
+    for (unsigned int i = 0; i < remaining; i++) {
+        cache->segments[class_index][i] = cache->segments[class_index][count + i];
+    }
+    cache->lengths[class_index] = remaining;
+}
+
+// Moves a batch of new segments of the given size class from the shared
+// Allocator to the cache.
+static void refill_class(struct ThreadCache *cache, unsigned int class_index) {
+    struct ConcurrentAllocator *concurrent = cache->owner;
+    pthread_mutex_lock(&concurrent->lock);
+    // The map should keep free spots to stay fast.
+    unsigned int count = CONCURRENT_MAP_LEN / 2 - concurrent->mapped;
+    if (count > CONCURRENT_BATCH_LEN) {
+        count = CONCURRENT_BATCH_LEN;
+    }
+    // The whole batch is carved at once, next to each other when possible.
+    block_ptr *segments =
+        &cache->segments[class_index][cache->lengths[class_index]];
+    block_malloc_n(&concurrent->allocator, 1u << class_index, count, segments);
+    // Only the segments that could be allocated are kept.
+    unsigned int allocated_count = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (segments[i] != BLOCK_PTR_NONE) {
+            map_insert(concurrent, segments[i], class_index);
+            segments[allocated_count] = segments[i];
+            allocated_count++;
+        }
+    }
+    cache->lengths[class_index] += allocated_count;
+    pthread_mutex_unlock(&concurrent->lock);
+}
+
+// Returns the size class of a segment carved for the thread caches, or
+// NO_CLASS. Safe to call without the lock.
+static unsigned int map_find(struct ConcurrentAllocator *concurrent,
+                             block_ptr allocated) {
+    // Each spot is read atomically, so the start and the size class of a
+    // segment are always seen together. A segment being moved by map_remove
+    // may be missed, but never mistaken for another one.
+    unsigned int spot = hash_of(allocated, CONCURRENT_MAP_LEN);
+    for (unsigned int i = 0; i < CONCURRENT_MAP_LEN; i++) {
+        uint64_t entry = atomic_load_explicit(&concurrent->class_map[spot],
+                                              memory_order_acquire);
+        if (entry == 0) {
+            break;
+        } else if ((block_ptr)(entry >> 32) == allocated) {
+            return (unsigned int)(entry & 0xFFFFFFFF) - 1;
+        }
+        spot = (spot + 1) & (CONCURRENT_MAP_LEN - 1);
+    }
+    return NO_CLASS;
+}
+
+// Records the size class of a segment carved for the thread caches.
+static void map_insert(struct ConcurrentAllocator *concurrent,
+                       block_ptr allocated, unsigned int class_index) {
+    unsigned int spot = hash_of(allocated, CONCURRENT_MAP_LEN);
+    while (atomic_load_explicit(&concurrent->class_map[spot],
+                                memory_order_relaxed) != 0) {
+        spot = (spot + 1) & (CONCURRENT_MAP_LEN - 1);
+    }
+    atomic_store_explicit(&concurrent->class_map[spot],
+                          ((uint64_t)allocated << 32) | (class_index + 1),
+                          memory_order_release);
+    concurrent->mapped++;
+}
+
+// Forgets a segment carved for the thread caches.
+static void map_remove(struct ConcurrentAllocator *concurrent,
+                       block_ptr allocated) {
+    const unsigned int mask = CONCURRENT_MAP_LEN - 1;
+    _Atomic uint64_t *map = concurrent->class_map;
+    unsigned int hole = hash_of(allocated, CONCURRENT_MAP_LEN);
+    while ((block_ptr)(atomic_load_explicit(&map[hole],
+                                            memory_order_relaxed) >>
+                       32) != allocated) {
+        hole = (hole + 1) & mask;
+    }
+    atomic_store_explicit(&map[hole], 0, memory_order_release);
+    concurrent->mapped--;
+    // The segments placed after the hole may have been pushed past it by a
+    // collision. We move them back into the hole when it lies between their
+    // home and their current spot. Each one is written to its new spot before
+    // its former spot is cleared.
+    for (unsigned int next = (hole + 1) & mask;; next = (next + 1) & mask) {
+        uint64_t entry = atomic_load_explicit(&map[next], memory_order_relaxed);
+        if (entry == 0) {
+            break;
+        }
+        unsigned int home = hash_of((block_ptr)(entry >> 32), CONCURRENT_MAP_LEN);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            atomic_store_explicit(&map[hole], entry, memory_order_release);
+            atomic_store_explicit(&map[next], 0, memory_order_release);
+            hole = next;
+        }
+    }
+}
+
+/************************************ EOF *************************************/
@@ -0,0 +1,86 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "deferred_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Like block_malloc, taking back a pending free of the same size when there is
+// one. Such allocations are neither counted nor recorded by the parent.
+block_ptr deferred_malloc(struct DeferredAllocator *deferred,
+                          unsigned int size) {
+    // The most recent frees come first, their blocks are the likeliest to
+    // still be in the cache.
+    for (unsigned int i = deferred->count; i > 0; i--) {
+        if (deferred->pending_sizes[i - 1] == size) {
+            block_ptr reused = deferred->pending[i - 1];
+            // The last pending free takes the spot of the reused one.
+            deferred->count--;
+            deferred->pending[i - 1] = deferred->pending[deferred->count];
+            deferred->pending_sizes[i - 1] =
+                deferred->pending_sizes[deferred->count];
+            deferred->reuses++;
+            return reused;
+        }
+    }
+    if ((size > largest_free(deferred->parent)) && (deferred->count > 0)) {
+        // The pending frees may merge into a segment big enough.
+        deferred_flush(deferred);
+    }
+    return block_malloc(deferred->parent, size);
+}
+
+// Like block_free, in constant time until the pending frees reach the
+// threshold.
+void deferred_free(struct DeferredAllocator *deferred, block_ptr allocated) {
+    // Sanity check.
+    assert(deferred->count < deferred->threshold);
+    deferred->pending[deferred->count] = allocated;
+    deferred->pending_sizes[deferred->count] =
+        block_size(deferred->parent, allocated);
+    deferred->count++;
+    if (deferred->count == deferred->threshold) {
+        deferred_flush(deferred);
+    }
+}
+
+// Gives all the pending frees back to the parent, merging them with their
+// neighbours in a single sorted sweep.
+void deferred_flush(struct DeferredAllocator *deferred) {
+    // block_free_n sorts the segments and merges the contiguous ones before
+    // they reach the free list.
+    block_free_n(deferred->parent, deferred->pending, deferred->count);
+    deferred->count = 0;
+}
+
+// Defines a new DeferredAllocator over the given parent, sweeping its pending
+// frees once there are threshold of them, at most DEFERRED_PENDING_LEN.
+struct DeferredAllocator new_deferred_allocator(struct Allocator *parent,
+                                                unsigned int threshold) {
+    // Sanity check.
+    assert((threshold > 0) && (threshold <= DEFERRED_PENDING_LEN));
+    struct DeferredAllocator deferred;
+    deferred.parent = parent;
+    deferred.threshold = threshold;
+    deferred.count = 0;
+    deferred.reuses = 0;
+    return deferred;
+}
+
+/************************************ EOF *************************************/
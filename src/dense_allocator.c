@@ -0,0 +1,303 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "dense_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+// Used to shift the arrays when a free segment comes or goes.
+#include <string.h>
+
+// Used for the SIMD comparisons, when available.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*********************************** MACROS ***********************************/
+
+// The SIMD instructions only compare signed integers. Flipping the highest bit
+// of both sides gives the same order as an unsigned comparison.
+#define SIGN_BIT 0x80000000u
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the index of the first free segment starting after the given address.
+static unsigned int find_following(const struct DenseAllocator *dense,
+                                   block_ptr address);
+
+// Adds a free segment at the given index of the arrays.
+static void insert_free(struct DenseAllocator *dense, unsigned int index,
+                        block_ptr start, unsigned int length);
+
+// Removes the free segment at the given index of the arrays.
+static void remove_free(struct DenseAllocator *dense, unsigned int index);
+
+// Returns the spot of the allocated table holding the segment starting at the
+// given address.
+static unsigned int find_allocated(const struct DenseAllocator *dense,
+                                   block_ptr allocated);
+
+// Adds an allocated segment to the allocated table.
+static void insert_allocated(struct DenseAllocator *dense,
+                             const struct Segment segment);
+
+// Removes the segment at the given spot from the allocated table, keeping the
+// following segments reachable from their home spot.
+static void remove_allocated(struct DenseAllocator *dense, unsigned int spot);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Like block_malloc, with a first fit search. Returns BLOCK_PTR_NONE when no
+// free segment is big enough or capacity allocations are live.
+block_ptr dense_malloc(struct DenseAllocator *dense, unsigned int size) {
+    // Sanity check.
+    assert(size > 0);
+    if (dense->live == dense->capacity) {
+        // The allocated table is full.
+        return BLOCK_PTR_NONE;
+    }
+    unsigned int index = dense_first_fit(dense->lengths, dense->length, size);
+    if (index == dense->length) {
+        return BLOCK_PTR_NONE;
+    }
+    block_ptr allocated = dense->starts[index];
+    if (dense->lengths[index] > size) {
+        // The allocated segment is cut from the beginning of the free one.
+        dense->starts[index] += size;
+        dense->lengths[index] -= size;
+    } else {
+        // EDGE CASE
+        // The free segment is allocated whole.
+        remove_free(dense, index);
+    }
+    insert_allocated(dense, (struct Segment){.start = allocated, .length = size});
+    return allocated;
+}
+
+// Like block_free, merging the segment with its neighbours.
+void dense_free(struct DenseAllocator *dense, block_ptr allocated) {
+    unsigned int spot = find_allocated(dense, allocated);
+    unsigned int size = dense->allocated[spot].length;
+    remove_allocated(dense, spot);
+    // The free segments around the freed one are found by dichotomy.
+    unsigned int following = find_following(dense, allocated);
+    int merges_before =
+        (following > 0) && (dense->starts[following - 1] +
+                                dense->lengths[following - 1] ==
+                            allocated);
+    int merges_after = (following < dense->length) &&
+                       (allocated + size == dense->starts[following]);
+    if (merges_before && merges_after) {
+        // The freed segment fills the gap between two free segments.
+        dense->lengths[following - 1] += size + dense->lengths[following];
+        remove_free(dense, following);
+    } else if (merges_before) {
+        dense->lengths[following - 1] += size;
+    } else if (merges_after) {
+        dense->starts[following] = allocated;
+        dense->lengths[following] += size;
+    } else {
+        insert_free(dense, following, allocated, size);
+    }
+}
+
+// Returns the number of blocks of an allocated segment.
+unsigned int dense_size(const struct DenseAllocator *dense,
+                        block_ptr allocated) {
+    return dense->allocated[find_allocated(dense, allocated)].length;
+}
+
+// Returns the index of the first of count lengths which is at least size, or
+// count if there is none. Uses AVX2 or SSE2 when the compiler targets them.
+unsigned int dense_first_fit(const unsigned int *lengths, unsigned int count,
+                             unsigned int size) {
+    // Sanity check, a length is at least size when it is above size - 1.
+    assert(size > 0);
+    unsigned int index = 0;
+#if defined(__AVX2__)
+    // Eight lengths are compared at once.
+    const __m256i sign = _mm256_set1_epi32((int)SIGN_BIT);
+    const __m256i threshold = _mm256_set1_epi32((int)((size - 1) ^ SIGN_BIT));
+    for (; index + 8 <= count; index += 8) {
+        __m256i chunk = _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *)&lengths[index]), sign);
+        int mask = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(chunk, threshold)));
+        if (mask != 0) {
+            return index + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    // Four lengths are compared at once.
+    const __m128i sign = _mm_set1_epi32((int)SIGN_BIT);
+    const __m128i threshold = _mm_set1_epi32((int)((size - 1) ^ SIGN_BIT));
+    for (; index + 4 <= count; index += 4) {
+        __m128i chunk = _mm_xor_si128(
+            _mm_loadu_si128((const __m128i *)&lengths[index]), sign);
+        int mask = _mm_movemask_ps(
+            _mm_castsi128_ps(_mm_cmpgt_epi32(chunk, threshold)));
+        if (mask != 0) {
+            return index + __builtin_ctz(mask);
+        }
+    }
+#endif
+    // The remaining lengths, or all of them without SIMD, are compared one by
+    // one.
+    for (; index < count; index++) {
+        if (lengths[index] >= size) {
+            return index;
+        }
+    }
+    return count;
+}
+
+// Returns the number of bytes of metadata needed by a DenseAllocator holding up
+// to capacity live allocations.
+size_t dense_metadata_size(unsigned int capacity) {
+    // The free arrays hold one more segment than there are live allocations.
+    return 2 * ((size_t)capacity + 1) * sizeof(unsigned int) +
+           hash_len_for(capacity) * sizeof(struct Segment);
+}
+
+// Defines a new DenseAllocator over the given memory, holding up to capacity
+// live allocations and storing its arrays in a metadata buffer of
+// dense_metadata_size(capacity) bytes. There are never more free segments than
+// live allocations plus one, which bounds the free arrays.
+struct DenseAllocator new_dense_allocator(const struct Segment memory,
+                                          unsigned int capacity,
+                                          void *metadata,
+                                          size_t metadata_size) {
+    // Sanity checks.
+    assert((memory.length > 0) && (capacity > 0));
+    assert(metadata_size >= dense_metadata_size(capacity));
+    struct DenseAllocator dense;
+    dense.memory = memory;
+    dense.capacity = capacity;
+    dense.live = 0;
+    dense.table_len = hash_len_for(capacity);
+    // We carve the arrays from the metadata buffer.
+    dense.lengths = metadata;
+    dense.starts = dense.lengths + capacity + 1;
+    dense.allocated = (struct Segment *)(dense.starts + capacity + 1);
+    for (unsigned int i = 0; i < dense.table_len; i++) {
+        dense.allocated[i].length = 0;
+    }
+    // The whole memory starts as a single free segment.
+    dense.length = 0;
+    insert_free(&dense, 0, memory.start, memory.length);
+    return dense;
+}
+
+// Internal functions.
+
+// Returns the index of the first free segment starting after the given address.
+static unsigned int find_following(const struct DenseAllocator *dense,
+                                   block_ptr address) {
+    unsigned int lowest = 0;
+    unsigned int highest = dense->length;
+    while (lowest < highest) {
+        unsigned int middle = lowest + (highest - lowest) / 2;
+        if (dense->starts[middle] <= address) {
+            lowest = middle + 1;
+        } else {
+            highest = middle;
+        }
+    }
+    return lowest;
+}
+
+// Adds a free segment at the given index of the arrays.
+static void insert_free(struct DenseAllocator *dense, unsigned int index,
+                        block_ptr start, unsigned int length) {
+    // Should never happen in our simplified case.
+    assert(dense->length <= dense->capacity);
+    // The following segments move up a spot to keep the arrays sorted.
+    unsigned int moved = dense->length - index;
+    memmove(&dense->lengths[index + 1], &dense->lengths[index],
+            moved * sizeof(unsigned int));
+    memmove(&dense->starts[index + 1], &dense->starts[index],
+            moved * sizeof(block_ptr));
+    dense->lengths[index] = length;
+    dense->starts[index] = start;
+    dense->length++;
+}
+
+// Removes the free segment at the given index of the arrays.
+static void remove_free(struct DenseAllocator *dense, unsigned int index) {
+    // The following segments move down a spot.
+    unsigned int moved = dense->length - index - 1;
+    memmove(&dense->lengths[index], &dense->lengths[index + 1],
+            moved * sizeof(unsigned int));
+    memmove(&dense->starts[index], &dense->starts[index + 1],
+            moved * sizeof(block_ptr));
+    dense->length--;
+}
+
+// Returns the spot of the allocated table holding the segment starting at the
+// given address.
+static unsigned int find_allocated(const struct DenseAllocator *dense,
+                                   block_ptr allocated) {
+    const unsigned int mask = dense->table_len - 1;
+    unsigned int spot = hash_of(allocated, dense->table_len);
+    // Segments are stored in the first empty spot after their home, so we only
+    // have to search up to the next empty one.
+    while (dense->allocated[spot].start != allocated) {
+        // Sanity check, the segment should be allocated.
+        assert(dense->allocated[spot].length > 0);
+        spot = (spot + 1) & mask;
+    }
+    // Sanity check, an empty spot may still hold the start of a former segment.
+    assert(dense->allocated[spot].length > 0);
+    return spot;
+}
+
+// Adds an allocated segment to the allocated table.
+static void insert_allocated(struct DenseAllocator *dense,
+                             const struct Segment segment) {
+    const unsigned int mask = dense->table_len - 1;
+    unsigned int spot = hash_of(segment.start, dense->table_len);
+    while (dense->allocated[spot].length > 0) {
+        spot = (spot + 1) & mask;
+    }
+    dense->allocated[spot] = segment;
+    dense->live++;
+}
+
+// Removes the segment at the given spot from the allocated table, keeping the
+// following segments reachable from their home spot.
+static void remove_allocated(struct DenseAllocator *dense, unsigned int spot) {
+    const unsigned int mask = dense->table_len - 1;
+    dense->allocated[spot].length = 0;
+    dense->live--;
+    unsigned int hole = spot;
+    // The segments placed after the hole may have been pushed past it by a
+    // collision. We move them back into the hole when it lies between their
+    // home and their current spot.
+    for (unsigned int next = (spot + 1) & mask;
+         dense->allocated[next].length > 0; next = (next + 1) & mask) {
+        unsigned int home = hash_of(dense->allocated[next].start, mask + 1);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            dense->allocated[hole] = dense->allocated[next];
+            dense->allocated[next].length = 0;
+            hole = next;
+        }
+    }
+}
+
+/************************************ EOF *************************************/
@@ -0,0 +1,137 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "handle_table.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+// Used for uintptr_t.
+#include <stdint.h>
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the new address of the given one after a compaction, given the runs
+// that moved sorted by address.
+static block_ptr relocated(const struct Relocation *relocations,
+                           unsigned int count, block_ptr address);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Allocates size blocks and returns their handle, or BLOCK_HANDLE_NONE if there
+// is no free handle or no room for the segment. A failed allocation may succeed
+// after handle_compact.
+block_handle handle_malloc(struct HandleTable *handles, unsigned int size) {
+    block_handle handle =
+        bitmap_find_clear(handles->used, handles->capacity, handles->rover);
+    if (handle == handles->capacity) {
+        // All the handles are in use.
+        return BLOCK_HANDLE_NONE;
+    }
+    block_ptr allocated = block_malloc(handles->allocator, size);
+    if (allocated == BLOCK_PTR_NONE) {
+        return BLOCK_HANDLE_NONE;
+    }
+    bitmap_set(handles->used, handle);
+    handles->addresses[handle] = allocated;
+    // The handles after this one are the most likely to be free.
+    handles->rover = (handle + 1 == handles->capacity) ? 0 : handle + 1;
+    return handle;
+}
+
+// Frees the segment of a handle, which can then be handed out again.
+void handle_free(struct HandleTable *handles, block_handle handle) {
+    // Sanity check.
+    assert((handle < handles->capacity) && bitmap_get(handles->used, handle));
+    block_free(handles->allocator, handles->addresses[handle]);
+    bitmap_clear(handles->used, handle);
+}
+
+// Returns the current address of the segment of a handle.
+block_ptr handle_resolve(const struct HandleTable *handles,
+                         block_handle handle) {
+    // Sanity check.
+    assert((handle < handles->capacity) && bitmap_get(handles->used, handle));
+    return handles->addresses[handle];
+}
+
+// Compacts the Allocator with block_compact and moves the addresses of the
+// handles along. The relocations are returned like for block_compact, for the
+// caller to move the contents of the segments.
+unsigned int handle_compact(struct HandleTable *handles,
+                            struct Relocation *relocations) {
+    unsigned int count = block_compact(handles->allocator, relocations);
+    for (block_handle handle = 0; handle < handles->capacity; handle++) {
+        if (bitmap_get(handles->used, handle)) {
+            handles->addresses[handle] =
+                relocated(relocations, count, handles->addresses[handle]);
+        }
+    }
+    return count;
+}
+
+// Returns the number of bytes of the buffer needed by a HandleTable of the
+// given capacity.
+size_t handle_table_size(unsigned int capacity) {
+    // The bitmap comes first since it has the strictest alignment.
+    return BITMAP_WORDS(capacity) * sizeof(bitmap_word) +
+           capacity * sizeof(block_ptr);
+}
+
+// Defines a new HandleTable of the given capacity over a buffer aligned on 8
+// bytes, for segments allocated from the given Allocator.
+struct HandleTable new_handle_table(struct Allocator *allocator, void *buffer,
+                                   unsigned int capacity) {
+    // Sanity check.
+    assert(((uintptr_t)buffer % sizeof(bitmap_word)) == 0);
+    struct HandleTable handles;
+    handles.allocator = allocator;
+    handles.used = buffer;
+    handles.addresses = (block_ptr *)(handles.used + BITMAP_WORDS(capacity));
+    handles.capacity = capacity;
+    handles.rover = 0;
+    bitmap_reset(handles.used, capacity);
+    return handles;
+}
+
+// Internal functions.
+
+// Returns the new address of the given one after a compaction, given the runs
+// that moved sorted by address.
+static block_ptr relocated(const struct Relocation *relocations,
+                           unsigned int count, block_ptr address) {
+    // We look for the last run starting at or before the address.
+    unsigned int lowest = 0;
+    unsigned int highest = count;
+    while (lowest < highest) {
+        unsigned int middle = lowest + (highest - lowest) / 2;
+        if (relocations[middle].from <= address) {
+            lowest = middle + 1;
+        } else {
+            highest = middle;
+        }
+    }
+    if (lowest == 0) {
+        // The address comes before all the runs, it did not move.
+        return address;
+    }
+    const struct Relocation *run = &relocations[lowest - 1];
+    // Sanity check, the blocks between two runs were free.
+    assert(address < run->from + run->length);
+    return address - (run->from - run->to);
+}
+
+/************************************ EOF *************************************/
@@ -0,0 +1,285 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "heap.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+// Used for UINT_MAX.
+#include <limits.h>
+
+// Used for uintptr_t.
+#include <stdint.h>
+
+// Used to copy the contents of a moved segment.
+#include <string.h>
+
+// Used to map the memory and give its pages back.
+#include <sys/mman.h>
+
+// Used for the size of the pages.
+#include <unistd.h>
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the number of blocks holding the given number of bytes, at least one,
+// or 0 if it does not fit in an unsigned int.
+static unsigned int blocks_for(const struct Heap *heap, size_t bytes);
+
+// Returns the given free-to-be segment extended over its free neighbours,
+// whose pages have not been given back unless they are long enough.
+static struct Segment unreleased_around(const struct Heap *heap,
+                                        const struct Segment segment);
+
+// Gives back the pages of a range of blocks which is now part of a free
+// segment, if that segment is long enough.
+static void release_pages(const struct Heap *heap, const struct Segment range);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Like malloc, over the blocks of the Allocator. Returns NULL when there is no
+// room left.
+void *heap_malloc(struct Heap *heap, size_t bytes) {
+    unsigned int size = blocks_for(heap, bytes);
+    if (size == 0) {
+        return NULL;
+    }
+    block_ptr allocated = block_malloc(heap->allocator, size);
+    if (allocated == BLOCK_PTR_NONE) {
+        return NULL;
+    }
+    return heap_pointer(heap, allocated);
+}
+
+// Like free. The pages of a free segment of at least release_blocks blocks are
+// given back to the system.
+void heap_free(struct Heap *heap, void *pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+    block_ptr allocated = heap_block(heap, pointer);
+    struct Segment freed = {.start = allocated,
+                            .length = block_size(heap->allocator, allocated)};
+    // The neighbours have to be looked at before they merge with the segment.
+    struct Segment range = unreleased_around(heap, freed);
+    block_free(heap->allocator, allocated);
+    release_pages(heap, range);
+}
+
+// Like realloc, growing the segment in place when possible. Returns NULL when
+// there is no room left, in which case the former segment is left untouched.
+void *heap_realloc(struct Heap *heap, void *pointer, size_t bytes) {
+    if (pointer == NULL) {
+        return heap_malloc(heap, bytes);
+    } else if (bytes == 0) {
+        heap_free(heap, pointer);
+        return NULL;
+    }
+    unsigned int size = blocks_for(heap, bytes);
+    if (size == 0) {
+        return NULL;
+    }
+    block_ptr allocated = heap_block(heap, pointer);
+    struct Segment former = {.start = allocated,
+                             .length = block_size(heap->allocator, allocated)};
+    if (size <= former.length) {
+        // The segment shrinks in place, its tail is free again.
+        struct Segment tail = {.start = allocated + size,
+                               .length = former.length - size};
+        if (tail.length > 0) {
+            struct Segment range = unreleased_around(heap, tail);
+            if (block_realloc(heap->allocator, allocated, size) ==
+                BLOCK_PTR_NONE) {
+                return NULL;
+            }
+            release_pages(heap, range);
+        }
+        return pointer;
+    }
+    // The neighbours have to be looked at before the segment moves.
+    struct Segment range = unreleased_around(heap, former);
+    block_ptr moved = block_realloc(heap->allocator, allocated, size);
+    if (moved == BLOCK_PTR_NONE) {
+        return NULL;
+    } else if (moved == allocated) {
+        // The segment grew in place, no page is freed.
+        return pointer;
+    }
+    // The segment moved, its contents come along. The former segment is free,
+    // but nothing was allocated since, so its bytes are still there.
+    void *moved_pointer = heap_pointer(heap, moved);
+    memcpy(moved_pointer, pointer, former.length * heap->block_size);
+    if (moved == range.start) {
+        // EDGE CASE
+        // The segment moved to the start of the free segment right before the
+        // former one, which is not free anymore.
+        range.start += size;
+        range.length -= size;
+    }
+    release_pages(heap, range);
+    return moved_pointer;
+}
+
+// Returns the address of a block.
+void *heap_pointer(const struct Heap *heap, block_ptr block) {
+    return heap->base +
+           (size_t)(block - heap->allocator->memory.start) * heap->block_size;
+}
+
+// Returns the block at an address handed out by the Heap.
+block_ptr heap_block(const struct Heap *heap, const void *pointer) {
+    size_t offset = (const unsigned char *)pointer - heap->base;
+    // Sanity check, the address should be the start of a block.
+    assert(offset % heap->block_size == 0);
+    return heap->allocator->memory.start + offset / heap->block_size;
+}
+
+// Sets the number of bytes from which free segments give their pages back to
+// the system, or never if it is 0. Only meant for private anonymous memory,
+// whose released pages read as zeros afterwards.
+void heap_release_above(struct Heap *heap, size_t bytes) {
+    size_t blocks = (bytes + heap->block_size - 1) / heap->block_size;
+    heap->release_blocks = (blocks > UINT_MAX) ? UINT_MAX : blocks;
+}
+
+// Defines a new Heap over a buffer of the caller, holding as many blocks of
+// block_size bytes as the memory of the Allocator. No pages are released.
+struct Heap new_heap(struct Allocator *allocator, void *buffer,
+                     size_t block_size) {
+    // Sanity check.
+    assert(block_size > 0);
+    struct Heap heap;
+    heap.allocator = allocator;
+    heap.base = buffer;
+    heap.block_size = block_size;
+    heap.page_size = sysconf(_SC_PAGESIZE);
+    heap.release_blocks = 0;
+    heap.mapped = 0;
+    return heap;
+}
+
+// Sets up a Heap over a new anonymous mapping, holding as many blocks of
+// block_size bytes as the memory of the Allocator. Transparent huge pages are
+// asked for when huge_pages is set, and the free segments of at least
+// HEAP_RELEASE_BYTES give their pages back. Returns 0 if the mapping fails.
+int map_heap(struct Heap *heap, struct Allocator *allocator, size_t block_size,
+             int huge_pages) {
+    size_t length = (size_t)allocator->memory.length * block_size;
+    // The pages are only committed once they are written to.
+    void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        // Only a hint, the system may have them disabled.
+        madvise(mapping, length, MADV_HUGEPAGE);
+    }
+#endif
+    *heap = new_heap(allocator, mapping, block_size);
+    heap->mapped = 1;
+    heap_release_above(heap, HEAP_RELEASE_BYTES);
+    return 1;
+}
+
+// Unmaps the memory of a Heap set up by map_heap.
+void unmap_heap(struct Heap *heap) {
+    // Sanity check.
+    assert(heap->mapped);
+    munmap(heap->base,
+           (size_t)heap->allocator->memory.length * heap->block_size);
+    heap->base = NULL;
+    heap->mapped = 0;
+}
+
+// Internal functions.
+
+// Returns the number of blocks holding the given number of bytes, at least one,
+// or 0 if it does not fit in an unsigned int.
+static unsigned int blocks_for(const struct Heap *heap, size_t bytes) {
+    size_t blocks = (bytes + heap->block_size - 1) / heap->block_size;
+    if (blocks == 0) {
+        // EDGE CASE
+        // Empty allocations still get an address of their own.
+        return 1;
+    }
+    return (blocks > UINT_MAX) ? 0 : blocks;
+}
+
+// Returns the given free-to-be segment extended over its free neighbours,
+// whose pages have not been given back unless they are long enough.
+static struct Segment unreleased_around(const struct Heap *heap,
+                                        const struct Segment segment) {
+    struct Segment range = segment;
+    if (heap->release_blocks == 0) {
+        // Nothing is ever released.
+        return range;
+    }
+    struct CircularList *list = &heap->allocator->list;
+    list_index before = find_ending_at(list, segment.start);
+    if (before != LIST_INDEX_NONE) {
+        unsigned int length = get_link(list, before)->segment.length;
+        if (length < heap->release_blocks) {
+            range.start -= length;
+            range.length += length;
+        }
+    }
+    list_index after = find_starting_at(list, end_of(segment));
+    if (after != LIST_INDEX_NONE) {
+        unsigned int length = get_link(list, after)->segment.length;
+        if (length < heap->release_blocks) {
+            range.length += length;
+        }
+    }
+    return range;
+}
+
+// Gives back the pages of a range of blocks which is now part of a free
+// segment, if that segment is long enough.
+static void release_pages(const struct Heap *heap, const struct Segment range) {
+    if (heap->release_blocks == 0) {
+        return;
+    }
+    struct CircularList *list = &heap->allocator->list;
+    // The free segment holding the range is the last one starting at or
+    // before it.
+    list_index index = find_preceding(list, range.start + 1);
+    struct Segment merged = get_link(list, index)->segment;
+    if (merged.length < heap->release_blocks) {
+        return;
+    }
+    // Only the pages lying entirely within the free segment can go, and only
+    // those touching the range may not have gone already.
+    const uintptr_t mask = heap->page_size - 1;
+    uintptr_t lowest =
+        ((uintptr_t)heap_pointer(heap, merged.start) + mask) & ~mask;
+    uintptr_t highest = (uintptr_t)heap_pointer(heap, end_of(merged)) & ~mask;
+    uintptr_t from = (uintptr_t)heap_pointer(heap, range.start) & ~mask;
+    uintptr_t to = ((uintptr_t)heap_pointer(heap, end_of(range)) + mask) & ~mask;
+    if (from < lowest) {
+        from = lowest;
+    }
+    if (to > highest) {
+        to = highest;
+    }
+    if (from < to) {
+        madvise((void *)from, to - from, MADV_DONTNEED);
+    }
+}
+
+/************************************ EOF *************************************/
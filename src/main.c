@@ -96,10 +96,10 @@ int debug_allocator(struct Allocator *allocator) {
     debug_list(&(allocator->list));
     puts("\n");
     // Printing infor on the allocated memory.
-    for (unsigned int i = 0; i < CIRCULAR_LIST_MAX_LEN; i++) {
+    for (unsigned int i = 0; i < allocator->table_len; i++) {
         printf("Pointer %d: ", i);
-        if (allocator->used[i]) {
-            debug_segment(allocator->allocated[i]);
+        if (get_allocated(allocator, i) != NULL) {
+            debug_segment(*get_allocated(allocator, i));
         } else {
             puts("<unused>");
         }
@@ -0,0 +1,99 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "region_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Returns size blocks from the region, carving it from the parent if needed, or
+// BLOCK_PTR_NONE if the region is full or cannot be carved.
+block_ptr region_malloc(struct RegionAllocator *region, unsigned int size) {
+    return region_malloc_aligned(region, size, 1);
+}
+
+// Like region_malloc, but the returned address is a multiple of alignment,
+// which must be a power of two.
+block_ptr region_malloc_aligned(struct RegionAllocator *region,
+                                unsigned int size, unsigned int alignment) {
+    // Sanity check.
+    assert((alignment != 0) && ((alignment & (alignment - 1)) == 0));
+    if (region->start == BLOCK_PTR_NONE) {
+        // The first allocation since the last reset carves the region.
+        region->start = block_malloc(region->parent, region->length);
+        if (region->start == BLOCK_PTR_NONE) {
+            return BLOCK_PTR_NONE;
+        }
+    }
+    // The blocks skipped to reach the aligned address are simply lost until
+    // the next release.
+    block_ptr allocated = region->start + region->offset;
+    unsigned int padding = (0u - allocated) & (alignment - 1);
+    if ((size > region->length - region->offset) ||
+        (padding > region->length - region->offset - size)) {
+        // The region is full.
+        return BLOCK_PTR_NONE;
+    }
+    region->offset += padding + size;
+    return allocated + padding;
+}
+
+// Does nothing, the blocks of a region come back with region_release or
+// region_reset.
+void region_free(struct RegionAllocator *region, block_ptr allocated) {
+    // Sanity check, the blocks should come from the region.
+    assert((region->start != BLOCK_PTR_NONE) && (allocated >= region->start) &&
+           (allocated < region->start + region->offset));
+}
+
+// Returns a checkpoint of the region, to be given to region_release.
+unsigned int region_mark(const struct RegionAllocator *region) {
+    return region->offset;
+}
+
+// Frees all the blocks handed out since the given checkpoint was taken.
+void region_release(struct RegionAllocator *region, unsigned int mark) {
+    // Sanity check, the checkpoint cannot be in the future.
+    assert(mark <= region->offset);
+    region->offset = mark;
+}
+
+// Frees all the blocks of the region at once, giving it back to the parent.
+void region_reset(struct RegionAllocator *region) {
+    if (region->start != BLOCK_PTR_NONE) {
+        block_free(region->parent, region->start);
+    }
+    region->start = BLOCK_PTR_NONE;
+    region->offset = 0;
+}
+
+// Defines a new RegionAllocator handing out up to length blocks from the given
+// parent Allocator.
+struct RegionAllocator new_region_allocator(struct Allocator *parent,
+                                            unsigned int length) {
+    // Sanity check.
+    assert(length > 0);
+    struct RegionAllocator region;
+    region.parent = parent;
+    region.length = length;
+    region.start = BLOCK_PTR_NONE;
+    region.offset = 0;
+    return region;
+}
+
+/************************************ EOF *************************************/
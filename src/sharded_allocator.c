@@ -0,0 +1,152 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "sharded_allocator.h"
+
+// Used to number the threads.
+#include <stdatomic.h>
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+/*********************************** MACROS ***********************************/
+
+// Marks a thread which has not been given a number yet.
+#define NO_THREAD_NUMBER ((unsigned int)-1)
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the index of the arena the calling thread allocates from first.
+static unsigned int home_arena(const struct ShardedAllocator *sharded);
+
+// Returns the index of the arena owning the given address.
+static unsigned int owner_arena(const struct ShardedAllocator *sharded,
+                                block_ptr address);
+
+/*********************************** GLOBALS **********************************/
+
+// The number given to the next thread.
+static atomic_uint next_thread_number;
+
+// The number of the calling thread, which chooses its home arena.
+static _Thread_local unsigned int thread_number = NO_THREAD_NUMBER;
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Sets up a ShardedAllocator in place, splitting the memory into arena_count
+// arenas. The metadata buffer, if not NULL, is shared evenly between the arenas
+// like for new_allocator_in. Otherwise each arena uses its own arrays.
+void init_sharded_allocator(struct ShardedAllocator *sharded,
+                            const struct Segment memory,
+                            unsigned int arena_count,
+                            enum AllocationPolicy policy, void *metadata,
+                            size_t metadata_size) {
+    // Sanity check, each arena needs at least one block.
+    assert((arena_count > 0) && (arena_count <= SHARDED_MAX_ARENAS));
+    assert(memory.length >= arena_count);
+    sharded->arena_count = arena_count;
+    sharded->start = memory.start;
+    sharded->arena_length = memory.length / arena_count;
+    // Each arena gets the same share of the metadata, keeping the alignment.
+    size_t arena_metadata_size =
+        (metadata_size / arena_count) / sizeof(bitmap_word) *
+        sizeof(bitmap_word);
+
+    struct Segment remaining_memory = memory;
+    for (unsigned int i = 0; i < arena_count; i++) {
+        struct Arena *arena = &sharded->arenas[i];
+        if (i + 1 < arena_count) {
+            arena->memory =
+                extract_from(&remaining_memory, sharded->arena_length);
+        } else {
+            // The last arena takes the remaining blocks.
+            arena->memory = remaining_memory;
+        }
+        if (metadata == NULL) {
+            arena->allocator =
+                new_allocator_with_policy(arena->memory, policy);
+        } else {
+            arena->allocator = new_allocator_in(
+                arena->memory, policy,
+                (char *)metadata + i * arena_metadata_size,
+                arena_metadata_size);
+        }
+        pthread_mutex_init(&arena->lock, NULL);
+    }
+}
+
+// Releases the resources of a ShardedAllocator.
+void destroy_sharded_allocator(struct ShardedAllocator *sharded) {
+    for (unsigned int i = 0; i < sharded->arena_count; i++) {
+        pthread_mutex_destroy(&sharded->arenas[i].lock);
+    }
+}
+
+// Thread-safe block_malloc, which tries the arena of the calling thread first
+// and then the other ones.
+block_ptr sharded_malloc(struct ShardedAllocator *sharded, unsigned int size) {
+    unsigned int home = home_arena(sharded);
+    for (unsigned int i = 0; i < sharded->arena_count; i++) {
+        // We go around the arenas starting from the home arena, so that
+        // threads falling back do not all pile up on the same arena.
+        struct Arena *arena =
+            &sharded->arenas[(home + i) % sharded->arena_count];
+        pthread_mutex_lock(&arena->lock);
+        if (largest_free(&arena->allocator) >= size) {
+            block_ptr allocated = block_malloc(&arena->allocator, size);
+            pthread_mutex_unlock(&arena->lock);
+            return allocated;
+        }
+        // This arena is exhausted, we try the next one.
+        pthread_mutex_unlock(&arena->lock);
+    }
+    // All the arenas are exhausted.
+    return BLOCK_PTR_NONE;
+}
+
+// Thread-safe block_free, which gives the segment back to the arena it comes
+// from.
+void sharded_free(struct ShardedAllocator *sharded, block_ptr allocated) {
+    struct Arena *arena = &sharded->arenas[owner_arena(sharded, allocated)];
+    pthread_mutex_lock(&arena->lock);
+    block_free(&arena->allocator, allocated);
+    pthread_mutex_unlock(&arena->lock);
+}
+
+// Internal functions.
+
+// Returns the index of the arena the calling thread allocates from first.
+static unsigned int home_arena(const struct ShardedAllocator *sharded) {
+    if (thread_number == NO_THREAD_NUMBER) {
+        // Threads are numbered in the order they first allocate, which spreads
+        // them evenly over the arenas.
+        thread_number = atomic_fetch_add(&next_thread_number, 1);
+    }
+    return thread_number % sharded->arena_count;
+}
+
+// Returns the index of the arena owning the given address.
+static unsigned int owner_arena(const struct ShardedAllocator *sharded,
+                                block_ptr address) {
+    // All the arenas have the same length, except for the last one.
+    unsigned int index = (address - sharded->start) / sharded->arena_length;
+    if (index >= sharded->arena_count) {
+        index = sharded->arena_count - 1;
+    }
+    return index;
+}
+
+/************************************ EOF *************************************/
@@ -0,0 +1,298 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "slab_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+// Used to check the alignment of the buffer.
+#include <stdint.h>
+
+/********************************* PROTOYPES **********************************/
+
+// Returns a bitmap word whose first count bits are set.
+static bitmap_word low_bits(unsigned int count);
+
+// Returns the index of the first slab with a free slot, or slab_count if there
+// is none.
+static unsigned int first_partial(const struct SlabAllocator *slab_allocator);
+
+// Returns the index of the slab holding the given slot.
+static unsigned int find_slab(const struct SlabAllocator *slab_allocator,
+                              block_ptr slot);
+
+// Returns the spot of the hash table holding the index of the slab starting at
+// the given address, or the empty spot where it would go.
+static unsigned int table_spot(const struct SlabAllocator *slab_allocator,
+                               block_ptr start);
+
+// Removes the spot of the hash table at the given index, keeping the following
+// spots reachable from their home spot.
+static void release_spot(struct SlabAllocator *slab_allocator,
+                         unsigned int spot);
+
+// Carves a new slab from the parent and returns its index, or capacity if
+// there is no room for it.
+static unsigned int add_slab(struct SlabAllocator *slab_allocator);
+
+// Gives the slab at the given index back to the parent.
+static void remove_slab(struct SlabAllocator *slab_allocator,
+                        unsigned int index);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Returns a free slot, carving a new slab from the parent if needed, or
+// BLOCK_PTR_NONE if no slab can be carved. The slabs with free slots are found
+// a bitmap word at a time.
+block_ptr slab_malloc(struct SlabAllocator *slab_allocator) {
+    unsigned int index = first_partial(slab_allocator);
+    if (index == slab_allocator->slab_count) {
+        index = add_slab(slab_allocator);
+        if (index == slab_allocator->capacity) {
+            return BLOCK_PTR_NONE;
+        }
+    }
+    struct Slab *slab = &slab_allocator->slabs[index];
+    if (slab->free_slots == low_bits(slab_allocator->slot_count)) {
+        // The slab was empty, it is not anymore.
+        slab_allocator->empty_slabs--;
+    }
+    unsigned int slot = __builtin_ctzll(slab->free_slots);
+    slab->free_slots &= ~((bitmap_word)1 << slot);
+    if (slab->free_slots == 0) {
+        // The slab is now full.
+        bitmap_clear(slab_allocator->partial_slabs, index);
+    }
+    return slab->start + slot * slab_allocator->slot_size;
+}
+
+// Gives a slot back to its slab, found in constant time. A single empty slab
+// is kept for the next allocations, the others go back to the parent.
+void slab_free(struct SlabAllocator *slab_allocator, block_ptr slot) {
+    unsigned int index = find_slab(slab_allocator, slot);
+    struct Slab *slab = &slab_allocator->slabs[index];
+    unsigned int slot_index = (slot - slab->start) / slab_allocator->slot_size;
+    // Sanity checks, the slot should have been handed out.
+    assert(slot == slab->start + slot_index * slab_allocator->slot_size);
+    assert((slab->free_slots & ((bitmap_word)1 << slot_index)) == 0);
+    slab->free_slots |= (bitmap_word)1 << slot_index;
+    bitmap_set(slab_allocator->partial_slabs, index);
+    if (slab->free_slots == low_bits(slab_allocator->slot_count)) {
+        if (slab_allocator->empty_slabs == 0) {
+            // The slab is kept, so that a slot allocated and freed over and
+            // over at a slab boundary does not go through the parent each
+            // time.
+            slab_allocator->empty_slabs++;
+        } else {
+            // Another slab is already empty, this run goes back to the parent.
+            remove_slab(slab_allocator, index);
+        }
+    }
+}
+
+// Returns the number of bytes of the buffer needed by a SlabAllocator holding
+// up to capacity slabs.
+size_t slab_table_size(unsigned int capacity) {
+    // The bitmap comes first, the arrays after it being aligned on 8 bytes.
+    return BITMAP_WORDS(capacity) * sizeof(bitmap_word) +
+           capacity * sizeof(struct Slab) +
+           hash_len_for(capacity) * sizeof(unsigned int);
+}
+
+// Defines a new SlabAllocator handing out slots of slot_size blocks from the
+// given parent Allocator, holding up to capacity slabs in a buffer aligned on
+// 8 bytes.
+struct SlabAllocator new_slab_allocator(struct Allocator *parent,
+                                        unsigned int slot_size, void *buffer,
+                                        unsigned int capacity) {
+    // Sanity checks.
+    assert((slot_size > 0) && (capacity > 0));
+    assert(((uintptr_t)buffer % sizeof(bitmap_word)) == 0);
+    struct SlabAllocator slab_allocator;
+    slab_allocator.parent = parent;
+    slab_allocator.slot_size = slot_size;
+    // As many slots as fit in a run, but at least one.
+    slab_allocator.slot_count = SLAB_RUN_LEN / slot_size;
+    if (slab_allocator.slot_count == 0) {
+        slab_allocator.slot_count = 1;
+    } else if (slab_allocator.slot_count > SLAB_MAX_SLOTS) {
+        slab_allocator.slot_count = SLAB_MAX_SLOTS;
+    }
+    // The smallest power of two holding a whole run.
+    slab_allocator.run_alignment = 1;
+    while (slab_allocator.run_alignment <
+           slab_allocator.slot_count * slot_size) {
+        slab_allocator.run_alignment *= 2;
+    }
+    slab_allocator.slab_count = 0;
+    slab_allocator.capacity = capacity;
+    slab_allocator.empty_slabs = 0;
+    slab_allocator.table_len = hash_len_for(capacity);
+    // We carve the arrays from the buffer.
+    slab_allocator.partial_slabs = buffer;
+    slab_allocator.slabs =
+        (struct Slab *)(slab_allocator.partial_slabs + BITMAP_WORDS(capacity));
+    slab_allocator.table = (unsigned int *)(slab_allocator.slabs + capacity);
+    bitmap_reset(slab_allocator.partial_slabs, capacity);
+    for (unsigned int i = 0; i < slab_allocator.table_len; i++) {
+        slab_allocator.table[i] = capacity;
+    }
+    return slab_allocator;
+}
+
+// Gives all the slabs back to the parent, whether their slots are free or not.
+void destroy_slab_allocator(struct SlabAllocator *slab_allocator) {
+    for (unsigned int i = 0; i < slab_allocator->slab_count; i++) {
+        block_free(slab_allocator->parent, slab_allocator->slabs[i].start);
+    }
+    for (unsigned int i = 0; i < slab_allocator->table_len; i++) {
+        slab_allocator->table[i] = slab_allocator->capacity;
+    }
+    slab_allocator->slab_count = 0;
+    slab_allocator->empty_slabs = 0;
+    bitmap_reset(slab_allocator->partial_slabs, slab_allocator->capacity);
+}
+
+// Internal functions.
+
+// Returns a bitmap word whose first count bits are set.
+static bitmap_word low_bits(unsigned int count) {
+    // Shifting by the whole width would be undefined.
+    if (count >= BITMAP_WORD_BITS) {
+        return ~(bitmap_word)0;
+    }
+    return ((bitmap_word)1 << count) - 1;
+}
+
+// Returns the index of the first slab with a free slot, or slab_count if there
+// is none.
+static unsigned int first_partial(const struct SlabAllocator *slab_allocator) {
+    // A whole word of full slabs is skipped at once.
+    for (unsigned int i = 0; i < BITMAP_WORDS(slab_allocator->slab_count);
+         i++) {
+        if (slab_allocator->partial_slabs[i] != 0) {
+            return i * BITMAP_WORD_BITS +
+                   __builtin_ctzll(slab_allocator->partial_slabs[i]);
+        }
+    }
+    return slab_allocator->slab_count;
+}
+
+// Returns the index of the slab holding the given slot.
+static unsigned int find_slab(const struct SlabAllocator *slab_allocator,
+                              block_ptr slot) {
+    // The runs are aligned, so the start of the slab is the slot without its
+    // low bits.
+    block_ptr start = slot & ~(slab_allocator->run_alignment - 1);
+    unsigned int index =
+        slab_allocator->table[table_spot(slab_allocator, start)];
+    // Sanity check, the slot should belong to a slab.
+    assert(index < slab_allocator->slab_count);
+    return index;
+}
+
+// Returns the spot of the hash table holding the index of the slab starting at
+// the given address, or the empty spot where it would go.
+static unsigned int table_spot(const struct SlabAllocator *slab_allocator,
+                               block_ptr start) {
+    const unsigned int mask = slab_allocator->table_len - 1;
+    unsigned int spot = hash_of(start, slab_allocator->table_len);
+    // The table is at most half full, so there always is an empty spot.
+    while ((slab_allocator->table[spot] != slab_allocator->capacity) &&
+           (slab_allocator->slabs[slab_allocator->table[spot]].start !=
+            start)) {
+        spot = (spot + 1) & mask;
+    }
+    return spot;
+}
+
+// Removes the spot of the hash table at the given index, keeping the following
+// spots reachable from their home spot.
+static void release_spot(struct SlabAllocator *slab_allocator,
+                         unsigned int spot) {
+    unsigned int *table = slab_allocator->table;
+    const unsigned int mask = slab_allocator->table_len - 1;
+    const unsigned int empty = slab_allocator->capacity;
+    // The spot is now a hole in the table.
+    table[spot] = empty;
+    unsigned int hole = spot;
+    // The slabs placed after the hole may have been pushed past it by a
+    // collision. We move them back into the hole when it lies between their
+    // home and their current spot.
+    for (unsigned int next = (spot + 1) & mask; table[next] != empty;
+         next = (next + 1) & mask) {
+        unsigned int home = hash_of(slab_allocator->slabs[table[next]].start,
+                                    slab_allocator->table_len);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            table[hole] = table[next];
+            table[next] = empty;
+            hole = next;
+        }
+    }
+}
+
+// Carves a new slab from the parent and returns its index, or capacity if
+// there is no room for it.
+static unsigned int add_slab(struct SlabAllocator *slab_allocator) {
+    if (slab_allocator->slab_count == slab_allocator->capacity) {
+        // The array of slabs is full.
+        return slab_allocator->capacity;
+    }
+    block_ptr start = block_malloc_aligned(
+        slab_allocator->parent,
+        slab_allocator->slot_count * slab_allocator->slot_size,
+        slab_allocator->run_alignment);
+    if (start == BLOCK_PTR_NONE) {
+        // The parent is full.
+        return slab_allocator->capacity;
+    }
+    // The new slab goes at the end of the array.
+    unsigned int index = slab_allocator->slab_count;
+    slab_allocator->slabs[index] =
+        (struct Slab){.start = start,
+                      .free_slots = low_bits(slab_allocator->slot_count)};
+    slab_allocator->table[table_spot(slab_allocator, start)] = index;
+    bitmap_set(slab_allocator->partial_slabs, index);
+    slab_allocator->slab_count++;
+    slab_allocator->empty_slabs++;
+    return index;
+}
+
+// Gives the slab at the given index back to the parent.
+static void remove_slab(struct SlabAllocator *slab_allocator,
+                        unsigned int index) {
+    block_ptr start = slab_allocator->slabs[index].start;
+    block_free(slab_allocator->parent, start);
+    release_spot(slab_allocator, table_spot(slab_allocator, start));
+    // The last slab takes the spot of the removed one, and so does its bit in
+    // the bitmap of partial slabs.
+    slab_allocator->slab_count--;
+    unsigned int last = slab_allocator->slab_count;
+    if (index != last) {
+        slab_allocator->slabs[index] = slab_allocator->slabs[last];
+        slab_allocator->table[table_spot(
+            slab_allocator, slab_allocator->slabs[index].start)] = index;
+        if (bitmap_get(slab_allocator->partial_slabs, last)) {
+            bitmap_set(slab_allocator->partial_slabs, index);
+        } else {
+            bitmap_clear(slab_allocator->partial_slabs, index);
+        }
+    }
+    bitmap_clear(slab_allocator->partial_slabs, last);
+}
+
+/************************************ EOF *************************************/
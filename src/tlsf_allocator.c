@@ -0,0 +1,279 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "tlsf_allocator.h"
+
+// Used for debugging, would be removed in production.
+#include <assert.h>
+
+// Used to check the alignment of metadata buffers.
+#include <stdint.h>
+
+/*********************************** MACROS ***********************************/
+
+// The bitmaps of both levels have to fit in an unsigned int.
+_Static_assert((TLSF_SL_LOG2 >= 1) && (TLSF_SL_LOG2 <= 5),
+               "TLSF_SL_LOG2 must be between 1 and 5");
+
+/********************************** STRUCTS ***********************************/
+
+// The range of lengths a free segment is sorted into.
+struct Range {
+    unsigned int first;  // The first level range.
+    unsigned int second; // The second level range.
+};
+
+/********************************* PROTOYPES **********************************/
+
+// Returns the range holding free segments of the given length.
+static struct Range range_of(unsigned int length);
+
+// Returns the first range whose free segments all hold at least size blocks,
+// rounding the size up to the next range.
+static struct Range range_for(unsigned int size);
+
+// Returns the first non empty range at or above the given one. The first level
+// of the returned range is TLSF_FL_COUNT if there is none.
+static struct Range find_range(const struct TlsfAllocator *tlsf,
+                               struct Range range);
+
+// Adds a free segment to the lists.
+static void insert_free(struct TlsfAllocator *tlsf, unsigned int offset,
+                        unsigned int length);
+
+// Removes the free segment at the given offset from the lists.
+static void remove_free(struct TlsfAllocator *tlsf, unsigned int offset);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Like block_malloc, but in constant time. Returns BLOCK_PTR_NONE when no free
+// segment is big enough.
+block_ptr tlsf_malloc(struct TlsfAllocator *tlsf, unsigned int size) {
+    if (size == 0) {
+        size = 1;
+    }
+    // Any free segment of the found range is big enough, so we take the first
+    // one instead of searching for the best one.
+    struct Range range = find_range(tlsf, range_for(size));
+    if (range.first == TLSF_FL_COUNT) {
+        // No free segment is big enough.
+        return BLOCK_PTR_NONE;
+    }
+    unsigned int offset = tlsf->heads[range.first][range.second];
+    unsigned int length = tlsf->lengths[offset];
+    remove_free(tlsf, offset);
+
+    if (length > size) {
+        // The remainder of the segment stays free.
+        insert_free(tlsf, offset + size, length - size);
+    }
+    tlsf->lengths[offset] = size;
+    bitmap_set(tlsf->used, offset);
+    return tlsf->memory.start + offset;
+}
+
+// Like block_free, merging the segment with its neighbours in constant time.
+void tlsf_free(struct TlsfAllocator *tlsf, block_ptr allocated) {
+    unsigned int offset = allocated - tlsf->memory.start;
+    // Sanity check, the segment should have been allocated.
+    assert(offset < tlsf->memory.length);
+    assert(bitmap_get(tlsf->used, offset) == 1);
+    bitmap_clear(tlsf->used, offset);
+    unsigned int length = tlsf->lengths[offset];
+
+    // The following segment starts right after the freed one.
+    unsigned int following = offset + length;
+    if ((following < tlsf->memory.length) &&
+        (bitmap_get(tlsf->free, following) == 1)) {
+        length += tlsf->lengths[following];
+        remove_free(tlsf, following);
+    }
+    // The preceding segment left its start on its last block. The value may
+    // be stale, so we check that it still describes a free segment ending
+    // right before the freed one.
+    if (offset > 0) {
+        unsigned int preceding = tlsf->starts[offset - 1];
+        if ((preceding < offset) && (bitmap_get(tlsf->free, preceding) == 1) &&
+            (preceding + tlsf->lengths[preceding] == offset)) {
+            length += tlsf->lengths[preceding];
+            remove_free(tlsf, preceding);
+            offset = preceding;
+        }
+    }
+    insert_free(tlsf, offset, length);
+}
+
+// Returns the number of blocks of an allocated segment.
+unsigned int tlsf_size(const struct TlsfAllocator *tlsf, block_ptr allocated) {
+    unsigned int offset = allocated - tlsf->memory.start;
+    // Sanity check, the segment should have been allocated.
+    assert(bitmap_get(tlsf->used, offset) == 1);
+    return tlsf->lengths[offset];
+}
+
+// Returns the number of bytes of metadata a TlsfAllocator needs to manage a
+// memory of the given number of blocks.
+size_t tlsf_metadata_size(unsigned int length) {
+    // The bitmaps come first since they have the strictest alignment.
+    return 2 * BITMAP_WORDS((size_t)length) * sizeof(bitmap_word) +
+           4 * (size_t)length * sizeof(unsigned int);
+}
+
+// Defines a new TlsfAllocator storing its arrays in the given metadata buffer,
+// which must be aligned on 8 bytes and hold tlsf_metadata_size(memory.length)
+// bytes.
+struct TlsfAllocator new_tlsf_allocator(const struct Segment memory,
+                                        void *metadata, size_t metadata_size) {
+    // Sanity checks.
+    assert(memory.length > 0);
+    assert(metadata_size >= tlsf_metadata_size(memory.length));
+    assert(((uintptr_t)metadata % sizeof(bitmap_word)) == 0);
+    struct TlsfAllocator tlsf;
+    tlsf.memory = memory;
+    tlsf.first_level = 0;
+    for (unsigned int i = 0; i < TLSF_FL_COUNT; i++) {
+        tlsf.second_level[i] = 0;
+        for (unsigned int j = 0; j < TLSF_SL_COUNT; j++) {
+            tlsf.heads[i][j] = TLSF_NONE;
+        }
+    }
+    tlsf.free_count = 0;
+
+    // We carve the arrays from the metadata buffer.
+    char *cursor = metadata;
+    tlsf.free = (bitmap_word *)cursor;
+    cursor += BITMAP_WORDS(memory.length) * sizeof(bitmap_word);
+    tlsf.used = (bitmap_word *)cursor;
+    cursor += BITMAP_WORDS(memory.length) * sizeof(bitmap_word);
+    tlsf.lengths = (unsigned int *)cursor;
+    cursor += memory.length * sizeof(unsigned int);
+    tlsf.next = (unsigned int *)cursor;
+    cursor += memory.length * sizeof(unsigned int);
+    tlsf.previous = (unsigned int *)cursor;
+    cursor += memory.length * sizeof(unsigned int);
+    tlsf.starts = (unsigned int *)cursor;
+    bitmap_reset(tlsf.free, memory.length);
+    bitmap_reset(tlsf.used, memory.length);
+
+    // The whole memory starts as a single free segment.
+    insert_free(&tlsf, 0, memory.length);
+    return tlsf;
+}
+
+// Internal functions.
+
+// Returns the range holding free segments of the given length.
+static struct Range range_of(unsigned int length) {
+    if (length < TLSF_SL_COUNT) {
+        // The small lengths each get their own second level range.
+        return (struct Range){.first = 0, .second = length};
+    }
+    unsigned int log2 = sizeof(unsigned int) * 8 - 1 - __builtin_clz(length);
+    // The second level is given by the bits following the leading one.
+    return (struct Range){
+        .first = log2 - TLSF_SL_LOG2 + 1,
+        .second = (length >> (log2 - TLSF_SL_LOG2)) - TLSF_SL_COUNT};
+}
+
+// Returns the first range whose free segments all hold at least size blocks,
+// rounding the size up to the next range.
+static struct Range range_for(unsigned int size) {
+    if (size < TLSF_SL_COUNT) {
+        return range_of(size);
+    }
+    unsigned int log2 = sizeof(unsigned int) * 8 - 1 - __builtin_clz(size);
+    // Rounding up may overflow for the biggest sizes, which then cannot be
+    // satisfied anyway.
+    unsigned long long rounded =
+        (unsigned long long)size + (1u << (log2 - TLSF_SL_LOG2)) - 1;
+    if (rounded > 0xFFFFFFFFull) {
+        return (struct Range){.first = TLSF_FL_COUNT, .second = 0};
+    }
+    return range_of((unsigned int)rounded);
+}
+
+// Returns the first non empty range at or above the given one. The first level
+// of the returned range is TLSF_FL_COUNT if there is none.
+static struct Range find_range(const struct TlsfAllocator *tlsf,
+                               struct Range range) {
+    if (range.first >= TLSF_FL_COUNT) {
+        return range;
+    }
+    // We first look in the same first level range.
+    unsigned int second_map =
+        tlsf->second_level[range.first] & (~0u << range.second);
+    if (second_map == 0) {
+        // Then in the smallest non empty bigger first level range.
+        unsigned int first_map = (range.first + 1 < 32)
+                                     ? tlsf->first_level &
+                                           (~0u << (range.first + 1))
+                                     : 0;
+        if (first_map == 0) {
+            return (struct Range){.first = TLSF_FL_COUNT, .second = 0};
+        }
+        range.first = __builtin_ctz(first_map);
+        second_map = tlsf->second_level[range.first];
+    }
+    range.second = __builtin_ctz(second_map);
+    return range;
+}
+
+// Adds a free segment to the lists.
+static void insert_free(struct TlsfAllocator *tlsf, unsigned int offset,
+                        unsigned int length) {
+    struct Range range = range_of(length);
+    unsigned int head = tlsf->heads[range.first][range.second];
+    tlsf->next[offset] = head;
+    tlsf->previous[offset] = TLSF_NONE;
+    if (head != TLSF_NONE) {
+        tlsf->previous[head] = offset;
+    }
+    tlsf->heads[range.first][range.second] = offset;
+    tlsf->first_level |= 1u << range.first;
+    tlsf->second_level[range.first] |= 1u << range.second;
+    // The last block remembers the start, for the following segment to find
+    // it once freed.
+    tlsf->lengths[offset] = length;
+    tlsf->starts[offset + length - 1] = offset;
+    bitmap_set(tlsf->free, offset);
+    tlsf->free_count++;
+}
+
+// Removes the free segment at the given offset from the lists.
+static void remove_free(struct TlsfAllocator *tlsf, unsigned int offset) {
+    struct Range range = range_of(tlsf->lengths[offset]);
+    unsigned int next = tlsf->next[offset];
+    unsigned int previous = tlsf->previous[offset];
+    if (previous != TLSF_NONE) {
+        tlsf->next[previous] = next;
+    } else {
+        tlsf->heads[range.first][range.second] = next;
+    }
+    if (next != TLSF_NONE) {
+        tlsf->previous[next] = previous;
+    }
+    if (tlsf->heads[range.first][range.second] == TLSF_NONE) {
+        // The range is now empty, and so may be its first level range.
+        tlsf->second_level[range.first] &= ~(1u << range.second);
+        if (tlsf->second_level[range.first] == 0) {
+            tlsf->first_level &= ~(1u << range.first);
+        }
+    }
+    bitmap_clear(tlsf->free, offset);
+    tlsf->free_count--;
+}
+
+/************************************ EOF *************************************/
@@ -0,0 +1,151 @@
+/********************************** METADATA **********************************/
+
+/*
+ * Contributors: roadelou
+ * Contacts:
+ * Creation Date: 2021-02-19
+ * Language: C Source
+ */
+
+/********************************** INCLUDES **********************************/
+
+// The header we are implementing.
+#include "trace.h"
+
+// Used to open and write the trace files.
+#include <fcntl.h>
+#include <unistd.h>
+
+// Used to map the trace files.
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Used for the timestamps.
+#include <time.h>
+
+/*********************************** MACROS ***********************************/
+
+// The records are read in place, so their layout must not depend on the
+// compiler.
+_Static_assert(sizeof(struct TraceHeader) == 16, "TraceHeader must be packed");
+_Static_assert(sizeof(struct TraceRecord) == 24, "TraceRecord must be packed");
+
+/********************************* PROTOYPES **********************************/
+
+// Writes the whole buffer to the file, even if the system writes it in parts.
+static void write_all(int file, const void *buffer, size_t size);
+
+/************************************ MAIN ************************************/
+
+/* The main function of your code goes here. */
+
+/********************************* FUNCTIONS **********************************/
+
+// Creates the trace file at the given path for an allocator managing the given
+// memory. Returns 0 if the file could not be created.
+int open_trace_recorder(struct TraceRecorder *recorder, const char *path,
+                        const struct Segment memory) {
+    recorder->file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (recorder->file < 0) {
+        return 0;
+    }
+    recorder->length = 0;
+    struct TraceHeader header = {.magic = TRACE_MAGIC,
+                                 .version = TRACE_VERSION,
+                                 .memory_start = memory.start,
+                                 .memory_length = memory.length};
+    write_all(recorder->file, &header, sizeof(header));
+    return 1;
+}
+
+// Adds a record to the buffer, writing the buffer out once it is full.
+void trace_record(struct TraceRecorder *recorder, enum TraceOp op,
+                  unsigned int size, block_ptr address, unsigned int argument) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    recorder->records[recorder->length] = (struct TraceRecord){
+        .op = op,
+        .size = size,
+        .address = address,
+        .argument = argument,
+        .timestamp = (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec};
+    recorder->length++;
+    if (recorder->length == TRACE_BUFFER_LEN) {
+        flush_trace_recorder(recorder);
+    }
+}
+
+// Writes the buffered records to the file.
+void flush_trace_recorder(struct TraceRecorder *recorder) {
+    write_all(recorder->file, recorder->records,
+              recorder->length * sizeof(struct TraceRecord));
+    recorder->length = 0;
+}
+
+// Writes the buffered records and closes the file.
+void close_trace_recorder(struct TraceRecorder *recorder) {
+    flush_trace_recorder(recorder);
+    close(recorder->file);
+    recorder->file = -1;
+}
+
+// Maps a trace file in memory. Returns 0 if the file could not be mapped or is
+// not a trace.
+int map_trace(struct MappedTrace *trace, const char *path) {
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return 0;
+    }
+    struct stat status;
+    if ((fstat(file, &status) != 0) ||
+        ((size_t)status.st_size < sizeof(struct TraceHeader))) {
+        close(file);
+        return 0;
+    }
+    void *mapping =
+        mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping stays valid once the file is closed.
+    close(file);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+    trace->header = mapping;
+    trace->records = (const struct TraceRecord *)(trace->header + 1);
+    trace->length = (status.st_size - sizeof(struct TraceHeader)) /
+                    sizeof(struct TraceRecord);
+    trace->mapped_size = status.st_size;
+    if ((trace->header->magic != TRACE_MAGIC) ||
+        (trace->header->version != TRACE_VERSION)) {
+        unmap_trace(trace);
+        return 0;
+    }
+    // The records are read in order, once.
+    madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+    return 1;
+}
+
+// Releases a mapped trace.
+void unmap_trace(struct MappedTrace *trace) {
+    munmap((void *)trace->header, trace->mapped_size);
+    trace->header = NULL;
+    trace->records = NULL;
+    trace->length = 0;
+}
+
+// Internal functions.
+
+// Writes the whole buffer to the file, even if the system writes it in parts.
+static void write_all(int file, const void *buffer, size_t size) {
+    const char *cursor = buffer;
+    while (size > 0) {
+        ssize_t written = write(file, cursor, size);
+        if (written <= 0) {
+            // The trace is incomplete, but the allocator keeps working.
+            return;
+        }
+        cursor += written;
+        size -= written;
+    }
+}
+
+/************************************ EOF *************************************/